@@ -0,0 +1,221 @@
+/**
+ * @file checkfile.c
+ * @brief libcheckfile, classification of files without globals or exits
+ * @date 2021-10-5
+ * @author Ricardo dos Santos Franco 2202314
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "checkfile.h"
+
+/**
+ * Compares the extension with the detected mime type
+ * @param ext extension of the file, without the '.', clamped to MAX_EXT_SIZE
+ * @param result struct with the mime type already filled
+ * @return CF_OK, CF_MISMATCH or CF_UNSUPPORTED
+ */
+static int validate(const char *ext, struct cf_result *result)
+{
+    snprintf(result->file_extension, MAX_EXT_SIZE, "%s", ext);
+
+    return mimeValidation(result->mime_type, result->file_extension, result->detected_extension);
+}
+
+/**
+ * Clears the result fields
+ * @param result struct to be cleared
+ * @return Nothing returned
+ */
+static void resetResult(struct cf_result *result)
+{
+    result->mime_type[0] = '\0';
+    result->file_extension[0] = '\0';
+    result->detected_extension[0] = '\0';
+    result->error = 0;
+}
+
+/**
+ * Classifies a file from its first bytes, already in memory
+ * @param ptr first bytes of the file (CF_HEADER_SIZE are enough)
+ * @param len number of bytes in ptr, 0 for an empty file
+ * @param ext extension of the file, without the '.', or NULL
+ * @param result struct where the detected types will be stored
+ * @return 	CF_OK -> extension matches the file type;
+ * 			CF_MISMATCH -> file type supported but extension doesn't match;
+ * 			CF_UNSUPPORTED -> file type not supported;
+ * 			CF_EMPTY -> empty file;
+ * 			CF_NO_EXTENSION -> ext is NULL or empty
+ */
+int classify_buffer(const void *ptr, size_t len, const char *ext, struct cf_result *result)
+{
+    resetResult(result);
+
+    if (len == 0)
+        return CF_EMPTY;
+
+    snprintf(result->mime_type, MAX_MIME_SIZE, "%s", mimeSniff(ptr, len));
+
+    if (ext == NULL || *ext == '\0')
+        return CF_NO_EXTENSION;
+
+    return validate(ext, result);
+}
+
+/**
+ * Reads the first bytes of a file. The file offset isn't changed when fd
+ * is seekable
+ * @param fd file descriptor open for reading
+ * @param buffer memory where the bytes will be stored
+ * @param size number of bytes of buffer
+ * @param len where the number of bytes read will be stored
+ * @return 	0 -> all ok;
+ * 			-1 -> error reading (errno is set)
+ */
+static int readHeader(int fd, void *buffer, size_t size, size_t *len)
+{
+    ssize_t n;
+    int seekable = 1;
+
+    *len = 0;
+
+    // Pipes and sockets can't be read with pread, falling back to read
+    while (*len < size)
+    {
+        if (seekable)
+            n = pread(fd, (char *)buffer + *len, size - *len, (off_t)*len);
+        else
+            n = read(fd, (char *)buffer + *len, size - *len);
+
+        if (n == -1 && seekable && errno == ESPIPE)
+        {
+            seekable = 0;
+            continue;
+        }
+
+        if (n == -1 && errno == EINTR)
+            continue;
+
+        if (n == -1)
+            return -1;
+
+        if (n == 0)
+            break;
+
+        *len += (size_t)n;
+    }
+
+    return 0;
+}
+
+/**
+ * Classifies an open file from its first bytes. The file offset isn't
+ * changed when fd is seekable
+ * @param fd file descriptor open for reading
+ * @param name name or path of the file, used to get the extension
+ * @param scratch memory where the first bytes will be read to
+ * @param scratch_size bytes of scratch, CF_HEADER_SIZE is recommended
+ * @param result struct where the detected types will be stored
+ * @return same values as classify_buffer or CF_ERROR when fd can't be read
+ */
+int classify_fd(int fd, const char *name, void *scratch, size_t scratch_size, struct cf_result *result)
+{
+    char file_extension[MAX_EXT_SIZE];
+    size_t len;
+
+    if (readHeader(fd, scratch, scratch_size, &len))
+    {
+        resetResult(result);
+        result->error = errno;
+        return CF_ERROR;
+    }
+
+    if (getFileExtension(file_extension, name))
+        file_extension[0] = '\0';
+
+    return classify_buffer(scratch, len, file_extension, result);
+}
+
+/**
+ * Classifies a file using the "file" program to detect its type
+ * @param path path to the file
+ * @param result struct where the detected types will be stored
+ * @return same values as classify_buffer, CF_ERROR when the file can't be
+ * 			opened or CF_NO_MIME when "file" didn't report a type
+ */
+int classify_path(const char *path, struct cf_result *result)
+{
+    return classify_path_dedup(NULL, path, result);
+}
+
+/**
+ * Classifies a file using the "file" program to detect its type, unless a
+ * file with the same size and first DEDUP_HASH_SIZE bytes was already
+ * detected. Only the extension is then compared
+ * @param dedup cache shared by the calls or NULL to always detect the type
+ * @param path path to the file
+ * @param result struct where the detected types will be stored
+ * @return same values as classify_path
+ */
+int classify_path_dedup(struct cf_dedup *dedup, const char *path, struct cf_result *result)
+{
+    char file_extension[MAX_EXT_SIZE];
+    unsigned char header[DEDUP_HASH_SIZE];
+    unsigned long long hash = 0;
+    size_t len = 0;
+    struct stat st;
+    int fd;
+    int cached = 0;
+
+    resetResult(result);
+
+    // Checking file
+    fd = open(path, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st))
+    {
+        result->error = errno;
+        if (fd != -1)
+            close(fd);
+        return CF_ERROR;
+    }
+
+    // Directories and devices are always given to "file"
+    if (!S_ISREG(st.st_mode))
+        dedup = NULL;
+
+    if (dedup != NULL && readHeader(fd, header, sizeof(header), &len))
+    {
+        result->error = errno;
+        close(fd);
+        return CF_ERROR;
+    }
+    close(fd);
+
+    if (st.st_size == 0)
+        return CF_EMPTY;
+
+    if (dedup != NULL)
+    {
+        hash = cf_dedup_hash(header, len, 0);
+        cached = cf_dedup_lookup(dedup, (long long)st.st_size, hash, result->mime_type, MAX_MIME_SIZE);
+    }
+
+    if (!cached)
+    {
+        if (mimeParsing(result->mime_type, MAX_MIME_SIZE, path))
+            return CF_NO_MIME;
+
+        // Not being able to cache only means the type will be detected again
+        if (dedup != NULL)
+            cf_dedup_insert(dedup, (long long)st.st_size, hash, result->mime_type);
+    }
+
+    if (getFileExtension(file_extension, path))
+        return CF_NO_EXTENSION;
+
+    return validate(file_extension, result);
+}
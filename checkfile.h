@@ -0,0 +1,46 @@
+/**
+ * @file checkfile.h
+ * @brief libcheckfile, classification of files without globals or exits
+ *
+ * Every function only touches the memory given by the caller, so the
+ * library can be used by several threads at the same time. The only shared
+ * state is the cache given to classify_path_dedup, which is locked
+ * internally, so callers may share one cache across threads.
+ * @date 2021-10-5
+ * @author Ricardo dos Santos Franco 2202314
+ */
+
+#ifndef CHECKFILE_H
+#define CHECKFILE_H
+
+#include <stddef.h>
+#include "mime.h"
+#include "dedup.h"
+
+// Bytes needed by classify_fd to detect the type of a file
+#define CF_HEADER_SIZE 4096
+
+// Values returned by the classify functions
+#define CF_OK 0
+#define CF_MISMATCH -1
+#define CF_UNSUPPORTED -2
+#define CF_ERROR -3
+#define CF_EMPTY -4
+#define CF_NO_MIME -5
+#define CF_NO_EXTENSION -6
+
+struct cf_result
+{
+    char mime_type[MAX_MIME_SIZE];
+    char file_extension[MAX_EXT_SIZE];
+    char detected_extension[MAX_EXT_SIZE];
+    // errno of the failed call when CF_ERROR is returned
+    int error;
+};
+
+int classify_buffer(const void *ptr, size_t len, const char *ext, struct cf_result *result);
+int classify_fd(int fd, const char *name, void *scratch, size_t scratch_size, struct cf_result *result);
+int classify_path(const char *path, struct cf_result *result);
+int classify_path_dedup(struct cf_dedup *dedup, const char *path, struct cf_result *result);
+
+#endif /* CHECKFILE_H */
@@ -0,0 +1,377 @@
+/**
+ * @file dedup.c
+ * @brief Cache of detected mime types shared by identical files
+ *
+ * Hash table with chained buckets. Each bucket is protected by one of
+ * DEDUP_LOCKS mutexes, so threads only wait for each other when they use
+ * buckets sharing a lock. Lookups and inserts also hold a shared read
+ * lock of the whole table, taken for writing only while the table doubles
+ * its buckets. Mime types are interned, entries keep an index to them.
+ * @date 2021-10-5
+ * @author Ricardo dos Santos Franco 2202314
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mime.h"
+#include "dedup.h"
+
+// Primes of the xxHash64 algorithm
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+struct dedup_entry
+{
+    long long size;
+    unsigned long long hash;
+    // index of the mime type in the types table
+    int type;
+    struct dedup_entry *next;
+};
+
+struct cf_dedup
+{
+    struct dedup_entry **buckets;
+    // always a power of 2, so the bucket is given by a mask of the hash
+    size_t bucket_count;
+    pthread_rwlock_t table_lock;
+    pthread_mutex_t locks[DEDUP_LOCKS];
+    atomic_size_t entries;
+    // types are only appended, an index never changes its string
+    char types[DEDUP_MAX_TYPES][MAX_MIME_SIZE];
+    int type_count;
+    pthread_mutex_t types_lock;
+    atomic_ullong lookups;
+    atomic_ullong hits;
+};
+
+static unsigned long long rotl64(unsigned long long value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Reads are done byte by byte so the hash is the same on any endianness
+static unsigned long long read64(const unsigned char *ptr)
+{
+    unsigned long long value = 0;
+
+    for (int i = 7; i >= 0; i--)
+        value = (value << 8) | ptr[i];
+
+    return value;
+}
+
+static unsigned long long read32(const unsigned char *ptr)
+{
+    return (unsigned long long)ptr[0] | (unsigned long long)ptr[1] << 8 | (unsigned long long)ptr[2] << 16 |
+           (unsigned long long)ptr[3] << 24;
+}
+
+static unsigned long long xxhRound(unsigned long long acc, unsigned long long input)
+{
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+
+    return acc * PRIME64_1;
+}
+
+static unsigned long long xxhMerge(unsigned long long acc, unsigned long long value)
+{
+    acc ^= xxhRound(0, value);
+
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+/**
+ * Computes the xxHash64 of a buffer
+ * @param ptr bytes to hash
+ * @param len number of bytes
+ * @param seed seed of the hash
+ * @return 64 bits hash
+ */
+unsigned long long cf_dedup_hash(const void *ptr, size_t len, unsigned long long seed)
+{
+    const unsigned char *p = ptr;
+    const unsigned char *end = p + len;
+    unsigned long long h;
+
+    if (len >= 32)
+    {
+        unsigned long long v1 = seed + PRIME64_1 + PRIME64_2;
+        unsigned long long v2 = seed + PRIME64_2;
+        unsigned long long v3 = seed;
+        unsigned long long v4 = seed - PRIME64_1;
+
+        // 32 bytes stripes, one 8 bytes lane for each accumulator
+        for (; p + 32 <= end; p += 32)
+        {
+            v1 = xxhRound(v1, read64(p));
+            v2 = xxhRound(v2, read64(p + 8));
+            v3 = xxhRound(v3, read64(p + 16));
+            v4 = xxhRound(v4, read64(p + 24));
+        }
+
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxhMerge(h, v1);
+        h = xxhMerge(h, v2);
+        h = xxhMerge(h, v3);
+        h = xxhMerge(h, v4);
+    }
+    else
+        h = seed + PRIME64_5;
+
+    h += len;
+
+    for (; p + 8 <= end; p += 8)
+        h = rotl64(h ^ xxhRound(0, read64(p)), 27) * PRIME64_1 + PRIME64_4;
+
+    if (p + 4 <= end)
+    {
+        h = rotl64(h ^ (read32(p) * PRIME64_1), 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+
+    for (; p < end; p++)
+        h = rotl64(h ^ (*p * PRIME64_5), 11) * PRIME64_1;
+
+    // Final mix so every input bit affects every output bit
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+/**
+ * Creates an empty cache
+ * @param expected expected number of distinct files, 0 if unknown. The
+ * 			table grows when needed, this only avoids the first resizes
+ * @return pointer to the cache or NULL if not hable to allocate memory
+ */
+struct cf_dedup *cf_dedup_create(size_t expected)
+{
+    struct cf_dedup *dedup = malloc(sizeof(struct cf_dedup));
+
+    if (dedup == NULL)
+        return NULL;
+
+    dedup->bucket_count = DEDUP_BUCKETS;
+    while (dedup->bucket_count * DEDUP_LOAD_FACTOR < expected)
+        dedup->bucket_count *= 2;
+
+    dedup->buckets = calloc(dedup->bucket_count, sizeof(struct dedup_entry *));
+
+    if (dedup->buckets == NULL)
+    {
+        free(dedup);
+        return NULL;
+    }
+
+    pthread_rwlock_init(&dedup->table_lock, NULL);
+    for (size_t i = 0; i < DEDUP_LOCKS; i++)
+        pthread_mutex_init(dedup->locks + i, NULL);
+    pthread_mutex_init(&dedup->types_lock, NULL);
+
+    dedup->type_count = 0;
+    atomic_init(&dedup->entries, 0);
+    atomic_init(&dedup->lookups, 0);
+    atomic_init(&dedup->hits, 0);
+
+    return dedup;
+}
+
+/**
+ * Gets the index of a mime type, adding it to the types table if needed
+ * @param dedup cache
+ * @param mime_type mime type
+ * @return index of the mime type or -1 if the table is full
+ */
+static int internType(struct cf_dedup *dedup, const char *mime_type)
+{
+    int index = -1;
+
+    pthread_mutex_lock(&dedup->types_lock);
+
+    for (int i = 0; i < dedup->type_count && index == -1; i++)
+        if (!strncmp(dedup->types[i], mime_type, MAX_MIME_SIZE - 1))
+            index = i;
+
+    if (index == -1 && dedup->type_count < DEDUP_MAX_TYPES)
+    {
+        index = dedup->type_count;
+        snprintf(dedup->types[index], MAX_MIME_SIZE, "%s", mime_type);
+        dedup->type_count++;
+    }
+
+    pthread_mutex_unlock(&dedup->types_lock);
+
+    return index;
+}
+
+/**
+ * Doubles the number of buckets and moves the entries to the new buckets
+ * @param dedup cache
+ * @return Nothing returned
+ */
+static void grow(struct cf_dedup *dedup)
+{
+    struct dedup_entry **buckets;
+    size_t bucket_count;
+
+    pthread_rwlock_wrlock(&dedup->table_lock);
+
+    // Another thread may have grown the table while this one waited
+    bucket_count = dedup->bucket_count * 2;
+    if (atomic_load(&dedup->entries) <= dedup->bucket_count * DEDUP_LOAD_FACTOR ||
+        (buckets = calloc(bucket_count, sizeof(struct dedup_entry *))) == NULL)
+    {
+        pthread_rwlock_unlock(&dedup->table_lock);
+        return;
+    }
+
+    // Entries are moved, not copied
+    for (size_t i = 0; i < dedup->bucket_count; i++)
+        while (dedup->buckets[i] != NULL)
+        {
+            struct dedup_entry *entry = dedup->buckets[i];
+            size_t bucket = (size_t)(entry->hash & (bucket_count - 1));
+
+            dedup->buckets[i] = entry->next;
+            entry->next = buckets[bucket];
+            buckets[bucket] = entry;
+        }
+
+    free(dedup->buckets);
+    dedup->buckets = buckets;
+    dedup->bucket_count = bucket_count;
+
+    pthread_rwlock_unlock(&dedup->table_lock);
+}
+
+/**
+ * Looks for the mime type of a file with the same size and hash
+ * @param dedup cache
+ * @param size size of the file in bytes
+ * @param hash hash of the first DEDUP_HASH_SIZE bytes of the file
+ * @param mime_type string where the mime type will be copied
+ * @param mime_size number of bytes of mime_type
+ * @return 	1 -> found;
+ * 			0 -> not found
+ */
+int cf_dedup_lookup(struct cf_dedup *dedup, long long size, unsigned long long hash, char *mime_type, size_t mime_size)
+{
+    int type = -1;
+
+    atomic_fetch_add(&dedup->lookups, 1);
+
+    pthread_rwlock_rdlock(&dedup->table_lock);
+    size_t bucket = (size_t)(hash & (dedup->bucket_count - 1));
+    pthread_mutex_t *lock = dedup->locks + bucket % DEDUP_LOCKS;
+
+    pthread_mutex_lock(lock);
+    for (struct dedup_entry *entry = dedup->buckets[bucket]; entry != NULL && type == -1; entry = entry->next)
+        if (entry->hash == hash && entry->size == size)
+            type = entry->type;
+    pthread_mutex_unlock(lock);
+    pthread_rwlock_unlock(&dedup->table_lock);
+
+    if (type == -1)
+        return 0;
+
+    // The type was written before the entry was inserted and never changes
+    snprintf(mime_type, mime_size, "%s", dedup->types[type]);
+    atomic_fetch_add(&dedup->hits, 1);
+
+    return 1;
+}
+
+/**
+ * Stores the mime type of a file
+ * @param dedup cache
+ * @param size size of the file in bytes
+ * @param hash hash of the first DEDUP_HASH_SIZE bytes of the file
+ * @param mime_type mime type detected for the file
+ * @return 	0 -> all ok;
+ * 			-1 -> not hable to allocate memory or too many distinct types
+ */
+int cf_dedup_insert(struct cf_dedup *dedup, long long size, unsigned long long hash, const char *mime_type)
+{
+    struct dedup_entry *entry;
+    int type = internType(dedup, mime_type);
+
+    if (type == -1 || (entry = malloc(sizeof(struct dedup_entry))) == NULL)
+        return -1;
+
+    entry->size = size;
+    entry->hash = hash;
+    entry->type = type;
+
+    // Two threads may insert the same file, the duplicate entry is harmless
+    pthread_rwlock_rdlock(&dedup->table_lock);
+    size_t bucket = (size_t)(hash & (dedup->bucket_count - 1));
+    pthread_mutex_t *lock = dedup->locks + bucket % DEDUP_LOCKS;
+
+    pthread_mutex_lock(lock);
+    entry->next = dedup->buckets[bucket];
+    dedup->buckets[bucket] = entry;
+    pthread_mutex_unlock(lock);
+
+    size_t entries = atomic_fetch_add(&dedup->entries, 1) + 1;
+    int full = entries > dedup->bucket_count * DEDUP_LOAD_FACTOR;
+    pthread_rwlock_unlock(&dedup->table_lock);
+
+    // Keeps the chains short, so lookups cost the same however many files there are
+    if (full)
+        grow(dedup);
+
+    return 0;
+}
+
+/**
+ * Gets the number of lookups and of hits of the cache
+ * @param dedup cache
+ * @param lookups where the number of lookups will be stored
+ * @param hits where the number of hits will be stored
+ * @return Nothing returned
+ */
+void cf_dedup_stats(struct cf_dedup *dedup, unsigned long long *lookups, unsigned long long *hits)
+{
+    *lookups = atomic_load(&dedup->lookups);
+    *hits = atomic_load(&dedup->hits);
+}
+
+/**
+ * Frees the cache and all its entries
+ * @param dedup cache, can be NULL
+ * @return Nothing returned
+ */
+void cf_dedup_free(struct cf_dedup *dedup)
+{
+    if (dedup == NULL)
+        return;
+
+    for (size_t i = 0; i < dedup->bucket_count; i++)
+        while (dedup->buckets[i] != NULL)
+        {
+            struct dedup_entry *next = dedup->buckets[i]->next;
+
+            free(dedup->buckets[i]);
+            dedup->buckets[i] = next;
+        }
+
+    for (size_t i = 0; i < DEDUP_LOCKS; i++)
+        pthread_mutex_destroy(dedup->locks + i);
+    pthread_mutex_destroy(&dedup->types_lock);
+    pthread_rwlock_destroy(&dedup->table_lock);
+
+    free(dedup->buckets);
+    free(dedup);
+}
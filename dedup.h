@@ -0,0 +1,37 @@
+/**
+ * @file dedup.h
+ * @brief Cache of detected mime types shared by identical files
+ *
+ * Files are identified by their size and by the hash of their first
+ * DEDUP_HASH_SIZE bytes. The cache can be used by several threads at the
+ * same time.
+ * @date 2021-10-5
+ * @author Ricardo dos Santos Franco 2202314
+ */
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stddef.h>
+
+// Bytes of each file used to compute the hash
+#define DEDUP_HASH_SIZE 4096
+// Initial number of buckets of the hash table, must be a power of 2
+#define DEDUP_BUCKETS 1024
+// The table doubles its buckets when it has more entries per bucket than this
+#define DEDUP_LOAD_FACTOR 2
+// Maximum number of distinct mime types kept, entries only store an index
+#define DEDUP_MAX_TYPES 256
+// Number of locks shared by the buckets
+#define DEDUP_LOCKS 64
+
+struct cf_dedup;
+
+struct cf_dedup *cf_dedup_create(size_t expected);
+unsigned long long cf_dedup_hash(const void *ptr, size_t len, unsigned long long seed);
+int cf_dedup_lookup(struct cf_dedup *dedup, long long size, unsigned long long hash, char *mime_type, size_t mime_size);
+int cf_dedup_insert(struct cf_dedup *dedup, long long size, unsigned long long hash, const char *mime_type);
+void cf_dedup_stats(struct cf_dedup *dedup, unsigned long long *lookups, unsigned long long *hits);
+void cf_dedup_free(struct cf_dedup *dedup);
+
+#endif /* DEDUP_H */
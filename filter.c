@@ -0,0 +1,245 @@
+/**
+ * @file filter.c
+ * @brief Include/exclude filters applied to directory entries
+ * @date 2021-10-5
+ * @author Ricardo dos Santos Franco 2202314
+ */
+
+// DT_* constants of struct dirent are not part of POSIX
+#define _DEFAULT_SOURCE
+
+#include <fnmatch.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "memory.h"
+#include "filter.h"
+
+/**
+ * Compiles one pattern into a rule, so the pattern is only inspected once
+ * @param rule rule where the compiled pattern will be stored
+ * @param pattern glob ("*.log", "thumb_*"), plain name or directory ("tmp/")
+ * @return 	0 -> rule compiled;
+ * 			-1 -> not hable to allocate memory
+ */
+static int compileRule(struct filter_rule *rule, const char *pattern)
+{
+    size_t length = strlen(pattern);
+
+    rule->dir_only = 0;
+    rule->kind = RULE_GLOB;
+
+    // +1 for the terminator '\0'
+    rule->pattern = MALLOC(length + 1);
+    if (rule->pattern == NULL)
+        return -1;
+
+    strcpy(rule->pattern, pattern);
+
+    // A trailing '/' only matches directories
+    if (length > 1 && rule->pattern[length - 1] == '/')
+    {
+        rule->dir_only = 1;
+        rule->pattern[--length] = '\0';
+    }
+
+    // "*.ext" without other wildcards only needs the extension to be compared
+    if (!strncmp(rule->pattern, "*.", 2) && strpbrk(rule->pattern + 2, "*?[.") == NULL)
+    {
+        rule->kind = RULE_EXTENSION;
+        memmove(rule->pattern, rule->pattern + 2, length - 1);
+    }
+    else if (strpbrk(rule->pattern, "*?[") == NULL)
+        rule->kind = RULE_NAME;
+
+    return 0;
+}
+
+/**
+ * Compiles a list of patterns
+ * @param rules where the pointer to the compiled rules will be stored
+ * @param patterns patterns given by the user
+ * @param count number of patterns
+ * @return 	0 -> all ok;
+ * 			-1 -> not hable to allocate memory
+ */
+static int compileRules(struct filter_rule **rules, char **patterns, size_t count)
+{
+    *rules = NULL;
+
+    if (count == 0)
+        return 0;
+
+    *rules = MALLOC(count * sizeof(struct filter_rule));
+    if (*rules == NULL)
+        return -1;
+
+    for (size_t i = 0; i < count; i++)
+        if (compileRule(*rules + i, patterns[i]))
+        {
+            for (size_t j = 0; j < i; j++)
+                FREE((*rules)[j].pattern);
+            FREE(*rules);
+            return -1;
+        }
+
+    return 0;
+}
+
+/**
+ * Checks if name matches one of the rules
+ * @param rules compiled rules
+ * @param count number of rules
+ * @param name entry name (without the dir path)
+ * @param is_dir 1 if the entry is a directory
+ * @return 	1 -> matches;
+ * 			0 -> doesn't match
+ */
+static int matchRules(const struct filter_rule *rules, size_t count, const char *name, int is_dir)
+{
+    const char *extension = strrchr(name, (int)'.');
+
+    // Like fnmatch with FNM_PERIOD, '*' doesn't match the leading '.' of hidden files
+    if (extension == name)
+        extension = NULL;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (rules[i].dir_only && !is_dir)
+            continue;
+
+        switch (rules[i].kind)
+        {
+        case RULE_EXTENSION:
+            if (extension != NULL && !strcmp(extension + 1, rules[i].pattern))
+                return 1;
+            break;
+
+        case RULE_NAME:
+            if (!strcmp(name, rules[i].pattern))
+                return 1;
+            break;
+
+        default:
+            if (!fnmatch(rules[i].pattern, name, FNM_PERIOD))
+                return 1;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Compiles the include/exclude patterns and size range given by the user
+ * @param filter struct where the compiled filter will be stored
+ * @param include patterns of entries to analyze
+ * @param include_count number of include patterns
+ * @param exclude patterns of entries to skip
+ * @param exclude_count number of exclude patterns
+ * @param min_size minimum file size in bytes or -1
+ * @param max_size maximum file size in bytes or -1
+ * @return 	0 -> all ok;
+ * 			-1 -> not hable to allocate memory
+ */
+int filterCompile(struct filter *filter, char **include, size_t include_count, char **exclude, size_t exclude_count, long min_size, long max_size)
+{
+    filter->include_count = include_count;
+    filter->exclude_count = exclude_count;
+    filter->min_size = min_size;
+    filter->max_size = max_size;
+    filter->exclude = NULL;
+    filter->dir_rules = 0;
+
+    if (compileRules(&filter->include, include, include_count))
+    {
+        filter->include_count = 0;
+        filter->exclude_count = 0;
+        return -1;
+    }
+
+    if (compileRules(&filter->exclude, exclude, exclude_count))
+    {
+        filter->exclude_count = 0;
+        filterFree(filter);
+        return -1;
+    }
+
+    for (size_t i = 0; i < include_count; i++)
+        filter->dir_rules |= filter->include[i].dir_only;
+
+    for (size_t i = 0; i < exclude_count; i++)
+        filter->dir_rules |= filter->exclude[i].dir_only;
+
+    return 0;
+}
+
+/**
+ * Decides if a directory entry should be skipped. Only the entry name and
+ * d_type are used, unless a size range was given
+ * @param filter compiled filter
+ * @param dir_fd file descriptor of the directory holding the entry
+ * @param dir_entry entry returned by readdir
+ * @return 	1 -> entry must be skipped;
+ * 			0 -> entry must be analyzed
+ */
+int filterSkip(const struct filter *filter, int dir_fd, const struct dirent *dir_entry)
+{
+    struct stat st;
+    int is_dir = dir_entry->d_type == DT_DIR;
+    int have_stat = 0;
+    int need_size = filter->min_size >= 0 || filter->max_size >= 0;
+
+    // Some file systems don't fill d_type, stat is only needed before the
+    // rules when some of them only apply to directories
+    if (dir_entry->d_type == DT_UNKNOWN && filter->dir_rules && !fstatat(dir_fd, dir_entry->d_name, &st, 0))
+    {
+        have_stat = 1;
+        is_dir = S_ISDIR(st.st_mode);
+    }
+
+    if (matchRules(filter->exclude, filter->exclude_count, dir_entry->d_name, is_dir))
+        return 1;
+
+    if (filter->include_count > 0 && !matchRules(filter->include, filter->include_count, dir_entry->d_name, is_dir))
+        return 1;
+
+    if (!need_size || is_dir)
+        return 0;
+
+    // When stat fails the entry isn't skipped so the error is reported
+    if (!have_stat && fstatat(dir_fd, dir_entry->d_name, &st, 0))
+        return 0;
+
+    // d_type may have been unknown, the size range doesn't apply to directories
+    if (S_ISDIR(st.st_mode))
+        return 0;
+
+    if (filter->min_size >= 0 && st.st_size < filter->min_size)
+        return 1;
+
+    if (filter->max_size >= 0 && st.st_size > filter->max_size)
+        return 1;
+
+    return 0;
+}
+
+/**
+ * Frees the memory of a compiled filter
+ * @param filter compiled filter
+ * @return Nothing returned
+ */
+void filterFree(struct filter *filter)
+{
+    for (size_t i = 0; i < filter->include_count; i++)
+        FREE(filter->include[i].pattern);
+
+    for (size_t i = 0; i < filter->exclude_count; i++)
+        FREE(filter->exclude[i].pattern);
+
+    FREE(filter->include);
+    FREE(filter->exclude);
+    filter->include_count = 0;
+    filter->exclude_count = 0;
+}
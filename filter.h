@@ -0,0 +1,43 @@
+/**
+ * @file filter.h
+ * @brief Include/exclude filters applied to directory entries
+ * @date 2021-10-5
+ * @author Ricardo dos Santos Franco 2202314
+ */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <dirent.h>
+
+// Kinds of compiled rules, from cheapest to most expensive to evaluate
+#define RULE_EXTENSION 0
+#define RULE_NAME 1
+#define RULE_GLOB 2
+
+struct filter_rule
+{
+    int kind;
+    // rule only applies to directories (pattern ended with '/')
+    int dir_only;
+    char *pattern;
+};
+
+struct filter
+{
+    struct filter_rule *include;
+    size_t include_count;
+    struct filter_rule *exclude;
+    size_t exclude_count;
+    // 1 when some rule only applies to directories ("tmp/")
+    int dir_rules;
+    // -1 when the bound was not given
+    long min_size;
+    long max_size;
+};
+
+int filterCompile(struct filter *filter, char **include, size_t include_count, char **exclude, size_t exclude_count, long min_size, long max_size);
+int filterSkip(const struct filter *filter, int dir_fd, const struct dirent *dir_entry);
+void filterFree(struct filter *filter);
+
+#endif /* FILTER_H */
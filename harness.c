@@ -0,0 +1,751 @@
+/**
+ * @file harness.c
+ * @brief Differential harness between the backends of libcheckfile
+ *
+ * The "file" backend (classify_path) and the in-process backend
+ * (classify_fd/classify_buffer) are run over a corpus or over mutated
+ * headers of the supported types. Both backends agree on a file when they
+ * report the same supported type, or both report it as not supported.
+ * @date 2021-10-5
+ * @author Ricardo dos Santos Franco 2202314
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "harness_args.h"
+#include "memory.h"
+#include "checkfile.h"
+
+#define BACKEND_FILE 0
+#define BACKEND_SNIFF 1
+
+// Biggest mutated header
+#define FUZZ_MAX_SIZE 256
+// Mutations are concentrated in the first bytes, where the magic numbers are
+#define FUZZ_MAGIC_SIZE 16
+#define FUZZ_MAX_MUTATIONS 4
+
+struct verdict
+{
+	int status;
+	char mime_type[MAX_MIME_SIZE];
+};
+
+struct corpus
+{
+	char **paths;
+	size_t count;
+};
+
+struct job
+{
+	pthread_mutex_t lock;
+	size_t next;
+	size_t count;
+	int backend;
+	const struct corpus *corpus;
+	struct verdict *verdicts;
+	// fuzz mode
+	unsigned long long seed;
+	size_t disagreements;
+	// headers given to both backends, a temporary file may fail to be created
+	size_t compared;
+	double busy[2];
+};
+
+struct fuzz_case
+{
+	unsigned char bytes[FUZZ_MAX_SIZE];
+	size_t length;
+	const char *type;
+};
+
+struct fuzz_template
+{
+	const char *type;
+	const char *bytes;
+	size_t length;
+};
+
+#define TEMPLATE(type, bytes) {(type), (bytes), sizeof(bytes) - 1}
+
+// Smallest headers of the supported types
+const struct fuzz_template templates[EXT_NUMBER] = {
+	TEMPLATE("pdf", "%PDF-1.4\n%\xe2\xe3\xcf\xd3\n1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n"),
+	TEMPLATE("gif", "GIF89a\x01\x00\x01\x00\x80\x00\x00\xff\xff\xff\x00\x00\x00!\xf9\x04\x01\x00\x00\x00\x00,\x00\x00\x00\x00\x01\x00\x01\x00\x00\x02\x02" "D\x01\x00;"),
+	TEMPLATE("jpeg", "\xff\xd8\xff\xe0\x00\x10JFIF\x00\x01\x01\x00\x00\x01\x00\x01\x00\x00\xff\xdb\x00\x43\x00\x08\x06\x06\x07\x06\x05\x08\x07\x07\x07\x09\x09\x08\x0a\x0c\x14\x0d\x0c\x0b\x0b\x0c\x19\x12\x13\x0f\xff\xd9"),
+	TEMPLATE("png", "\x89PNG\r\n\x1a\n\x00\x00\x00\rIHDR\x00\x00\x00\x01\x00\x00\x00\x01\x08\x06\x00\x00\x00\x1f\x15\xc4\x89\x00\x00\x00\x00IEND\xae\x42\x60\x82"),
+	TEMPLATE("mp4", "\x00\x00\x00\x18" "ftypisom\x00\x00\x02\x00isomiso2\x00\x00\x00\x08" "free\x00\x00\x00\x08mdat"),
+	TEMPLATE("7z", "7z\xbc\xaf\x27\x1c\x00\x04\x8d\x9b\xd5\x0f\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"),
+	TEMPLATE("html", "<!DOCTYPE html>\n<html>\n<head><title>checkFile</title></head>\n<body><p>fuzz</p></body>\n</html>\n"),
+};
+
+// Read by crashHandler, so a crash can be reproduced with --seed
+unsigned long long fuzz_seed = 0;
+_Thread_local long long current_iteration = -1;
+
+/**
+ * Seconds of a monotonic clock
+ * @return seconds since an unspecified point
+ */
+double wallTime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * CPU seconds (user + system) used by the process and by its waited children
+ * @return CPU seconds
+ */
+double cpuTime(void)
+{
+	struct rusage self, children;
+
+	getrusage(RUSAGE_SELF, &self);
+	getrusage(RUSAGE_CHILDREN, &children);
+
+	return self.ru_utime.tv_sec + self.ru_utime.tv_usec / 1e6 + self.ru_stime.tv_sec + self.ru_stime.tv_usec / 1e6 +
+		   children.ru_utime.tv_sec + children.ru_utime.tv_usec / 1e6 + children.ru_stime.tv_sec + children.ru_stime.tv_usec / 1e6;
+}
+
+/**
+ * Writes an unsigned number to stderr, only with async-signal-safe calls
+ * @param value number to write
+ * @return Nothing returned
+ */
+void writeNumber(unsigned long long value)
+{
+	char digits[24];
+	size_t i = sizeof(digits);
+
+	do
+	{
+		digits[--i] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value);
+
+	write(STDERR_FILENO, digits + i, sizeof(digits) - i);
+}
+
+/**
+ * Reports the fuzz iteration that crashed and lets the signal kill the process
+ * @param signal signal received (SIGSEGV, SIGBUS, SIGFPE or SIGABRT)
+ * @return Nothing returned
+ */
+void crashHandler(int signal)
+{
+	if (current_iteration >= 0)
+	{
+		write(STDERR_FILENO, "[CRASH] fuzz iteration ", 23);
+		writeNumber((unsigned long long)current_iteration);
+		write(STDERR_FILENO, " with --seed ", 13);
+		writeNumber(fuzz_seed);
+		write(STDERR_FILENO, "\n", 1);
+	}
+
+	// SA_RESETHAND already restored the default action
+	raise(signal);
+}
+
+/**
+ * Classifies a file with one of the backends
+ * @param backend BACKEND_FILE or BACKEND_SNIFF
+ * @param path path to the file
+ * @param verdict where the status and the mime type will be stored
+ * @return Nothing returned
+ */
+void classify(int backend, const char *path, struct verdict *verdict)
+{
+	struct cf_result result;
+	unsigned char scratch[CF_HEADER_SIZE];
+	int fd;
+
+	if (backend == BACKEND_FILE)
+		verdict->status = classify_path(path, &result);
+	else if ((fd = open(path, O_RDONLY)) == -1)
+	{
+		verdict->status = CF_ERROR;
+		result.mime_type[0] = '\0';
+	}
+	else
+	{
+		verdict->status = classify_fd(fd, path, scratch, sizeof(scratch), &result);
+		close(fd);
+	}
+
+	strcpy(verdict->mime_type, result.mime_type);
+}
+
+/**
+ * Gets the type, as seen by checkFile, of a verdict
+ * @param verdict status and mime type returned by a backend
+ * @param type string with MAX_EXT_SIZE bytes where the type will be stored
+ * @return Nothing returned
+ */
+void verdictType(const struct verdict *verdict, char *type)
+{
+	switch (verdict->status)
+	{
+	case CF_ERROR:
+		strcpy(type, "error");
+		break;
+
+	case CF_EMPTY:
+		strcpy(type, "empty");
+		break;
+
+	case CF_NO_MIME:
+		strcpy(type, "no mime");
+		break;
+
+	default:
+		// Extension is irrelevant, only the detected type is compared
+		if (mimeValidation(verdict->mime_type, "", type) == CF_UNSUPPORTED)
+			strcpy(type, "unsupported");
+		break;
+	}
+}
+
+/**
+ * Checks if both backends agree
+ * @param file verdict of the "file" backend
+ * @param sniff verdict of the in-process backend
+ * @return 	1 -> backends agree;
+ * 			0 -> backends disagree
+ */
+int agree(const struct verdict *file, const struct verdict *sniff)
+{
+	char file_type[MAX_EXT_SIZE];
+	char sniff_type[MAX_EXT_SIZE];
+
+	verdictType(file, file_type);
+	verdictType(sniff, sniff_type);
+
+	return !strcmp(file_type, sniff_type);
+}
+
+/**
+ * Gets the index of the next item of a job
+ * @param job job shared by the worker threads
+ * @param index where the index will be stored
+ * @return 	1 -> index taken;
+ * 			0 -> no more items
+ */
+int takeNext(struct job *job, size_t *index)
+{
+	int taken = 0;
+
+	pthread_mutex_lock(&job->lock);
+	if (job->next < job->count)
+	{
+		*index = job->next++;
+		taken = 1;
+	}
+	pthread_mutex_unlock(&job->lock);
+
+	return taken;
+}
+
+/**
+ * Worker thread of the corpus mode, runs one backend over the corpus
+ * @param arg job shared by the worker threads
+ * @return NULL
+ */
+void *corpusWorker(void *arg)
+{
+	struct job *job = arg;
+	size_t i;
+
+	while (takeNext(job, &i))
+		classify(job->backend, job->corpus->paths[i], job->verdicts + i);
+
+	return NULL;
+}
+
+/**
+ * Next pseudo-random number (splitmix64)
+ * @param state generator state
+ * @return random number
+ */
+unsigned long long nextRandom(unsigned long long *state)
+{
+	unsigned long long z = (*state += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+	return z ^ (z >> 31);
+}
+
+/**
+ * Builds the mutated header of a fuzz iteration. The same seed and
+ * iteration always give the same header, whatever thread runs it
+ * @param seed seed of the run
+ * @param iteration number of the iteration
+ * @param fuzz_case where the header will be stored
+ * @return Nothing returned
+ */
+void makeCase(unsigned long long seed, long long iteration, struct fuzz_case *fuzz_case)
+{
+	unsigned long long state = seed ^ ((unsigned long long)iteration * 0xd1b54a32d192ed03ULL);
+	const struct fuzz_template *template = templates + nextRandom(&state) % EXT_NUMBER;
+	int mutations = 1 + (int)(nextRandom(&state) % FUZZ_MAX_MUTATIONS);
+
+	fuzz_case->type = template->type;
+	fuzz_case->length = template->length;
+	memcpy(fuzz_case->bytes, template->bytes, template->length);
+
+	for (int i = 0; i < mutations; i++)
+	{
+		unsigned long long bits = nextRandom(&state);
+		size_t limit = (bits & 1) && fuzz_case->length > FUZZ_MAGIC_SIZE ? FUZZ_MAGIC_SIZE : fuzz_case->length;
+		size_t position = (size_t)((bits >> 8) % limit);
+		unsigned char value = (unsigned char)(bits >> 40);
+
+		switch ((bits >> 1) % 4)
+		{
+		case 0:
+			fuzz_case->bytes[position] ^= (unsigned char)(1 << (value % 8));
+			break;
+
+		case 1:
+			fuzz_case->bytes[position] = value;
+			break;
+
+		case 2:
+			// At least one byte, empty files aren't classified by any backend
+			fuzz_case->length = position + 1;
+			break;
+
+		default:
+			if (fuzz_case->length < FUZZ_MAX_SIZE)
+			{
+				memmove(fuzz_case->bytes + position + 1, fuzz_case->bytes + position, fuzz_case->length - position);
+				fuzz_case->bytes[position] = value;
+				fuzz_case->length++;
+			}
+			break;
+		}
+	}
+}
+
+/**
+ * Reports a fuzz iteration where the backends disagree
+ * @param iteration number of the iteration
+ * @param fuzz_case mutated header
+ * @param file verdict of the "file" backend
+ * @param sniff verdict of the in-process backend
+ * @return Nothing returned
+ */
+void showFuzzDiff(long long iteration, const struct fuzz_case *fuzz_case, const struct verdict *file, const struct verdict *sniff)
+{
+	char line[3 * FUZZ_MAGIC_SIZE + 1] = "";
+	size_t length = fuzz_case->length < FUZZ_MAGIC_SIZE ? fuzz_case->length : FUZZ_MAGIC_SIZE;
+
+	for (size_t i = 0; i < length; i++)
+		sprintf(line + 3 * i, " %02x", fuzz_case->bytes[i]);
+
+	printf("[DIFF] fuzz iteration %lld (%s, %zu bytes):%s: file '%s', sniff '%s'\n", iteration, fuzz_case->type, fuzz_case->length, line,
+		   file->mime_type, sniff->mime_type);
+}
+
+/**
+ * Worker thread of the fuzz mode, runs both backends over mutated headers
+ * @param arg job shared by the worker threads
+ * @return NULL
+ */
+void *fuzzWorker(void *arg)
+{
+	struct job *job = arg;
+	struct fuzz_case fuzz_case;
+	struct verdict file, sniff;
+	struct cf_result result;
+	char path[] = "/tmp/checkFileHarnessXXXXXX";
+	double busy[2] = {0, 0};
+	size_t disagreements = 0;
+	size_t compared = 0;
+	double start;
+	size_t i;
+	int fd;
+
+	while (takeNext(job, &i))
+	{
+		current_iteration = (long long)i;
+		makeCase(job->seed, current_iteration, &fuzz_case);
+
+		start = wallTime();
+		sniff.status = classify_buffer(fuzz_case.bytes, fuzz_case.length, NULL, &result);
+		strcpy(sniff.mime_type, result.mime_type);
+		busy[BACKEND_SNIFF] += wallTime() - start;
+
+		// "file" needs the header on disk
+		strcpy(path + strlen(path) - 6, "XXXXXX");
+		if ((fd = mkstemp(path)) == -1 || write(fd, fuzz_case.bytes, fuzz_case.length) != (ssize_t)fuzz_case.length)
+		{
+			fprintf(stderr, "[ERROR] cannot create temporary file '%s' -- %s\n", path, strerror(errno));
+			if (fd != -1)
+			{
+				close(fd);
+				unlink(path);
+			}
+			continue;
+		}
+		close(fd);
+
+		start = wallTime();
+		classify(BACKEND_FILE, path, &file);
+		busy[BACKEND_FILE] += wallTime() - start;
+		unlink(path);
+		compared++;
+
+		if (!agree(&file, &sniff))
+		{
+			pthread_mutex_lock(&job->lock);
+			showFuzzDiff(current_iteration, &fuzz_case, &file, &sniff);
+			pthread_mutex_unlock(&job->lock);
+			disagreements++;
+		}
+	}
+
+	current_iteration = -1;
+
+	pthread_mutex_lock(&job->lock);
+	job->disagreements += disagreements;
+	job->compared += compared;
+	job->busy[BACKEND_FILE] += busy[BACKEND_FILE];
+	job->busy[BACKEND_SNIFF] += busy[BACKEND_SNIFF];
+	pthread_mutex_unlock(&job->lock);
+
+	return NULL;
+}
+
+/**
+ * Runs a worker function in several threads until the job is done
+ * @param worker corpusWorker or fuzzWorker
+ * @param job job shared by the worker threads
+ * @param threads number of threads
+ * @return 	0 -> all ok;
+ * 			-1 -> not hable to create the threads
+ */
+int runJob(void *(*worker)(void *), struct job *job, int threads)
+{
+	pthread_t *tids = MALLOC(threads * sizeof(pthread_t));
+	int created = 0;
+
+	if (tids == NULL)
+		return -1;
+
+	job->next = 0;
+
+	for (; created < threads; created++)
+		if ((errno = pthread_create(tids + created, NULL, worker, job)))
+		{
+			fprintf(stderr, "[ERROR] cannot create thread -- %s\n", strerror(errno));
+			break;
+		}
+
+	for (int i = 0; i < created; i++)
+		pthread_join(tids[i], NULL);
+
+	FREE(tids);
+
+	return created == threads ? 0 : -1;
+}
+
+/**
+ * Adds a path to the corpus
+ * @param corpus corpus
+ * @param path path to the file
+ * @return 	0 -> all ok;
+ * 			-1 -> not hable to allocate memory
+ */
+int addPath(struct corpus *corpus, const char *path)
+{
+	char **paths = realloc(corpus->paths, (corpus->count + 1) * sizeof(char *));
+
+	if (paths == NULL)
+		return -1;
+
+	corpus->paths = paths;
+
+	// +1 for the terminator '\0'
+	corpus->paths[corpus->count] = MALLOC(strlen(path) + 1);
+	if (corpus->paths[corpus->count] == NULL)
+		return -1;
+
+	strcpy(corpus->paths[corpus->count++], path);
+
+	return 0;
+}
+
+/**
+ * Lists the regular files of a dir or of a batch file
+ * @param corpus corpus where the paths will be stored
+ * @param dir_path dir with the files or NULL
+ * @param batch_path file with one path per line or NULL
+ * @return 	0 -> all ok;
+ * 			-1 -> error detected
+ */
+int loadCorpus(struct corpus *corpus, const char *dir_path, const char *batch_path)
+{
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t length;
+	struct dirent *dir_entry;
+	struct stat st;
+	DIR *dir;
+	FILE *file;
+	const char *separator = "";
+	int ret = 0;
+
+	if (batch_path != NULL)
+	{
+		if ((file = fopen(batch_path, "r")) == NULL)
+		{
+			fprintf(stderr, "[ERROR] cannot open file '%s' -- %s\n", batch_path, strerror(errno));
+			return -1;
+		}
+
+		// getline grows the line, long paths aren't split in two entries
+		while (!ret && (length = getline(&line, &line_size, file)) != -1)
+		{
+			if (length > 0 && line[length - 1] == '\n')
+				line[length - 1] = '\0';
+			if (line[0] != '\0' && addPath(corpus, line))
+				ret = -1;
+		}
+
+		if (!ret && ferror(file))
+		{
+			fprintf(stderr, "[ERROR] cannot read from file '%s' -- %s\n", batch_path, strerror(errno));
+			ret = -1;
+		}
+
+		free(line);
+		fclose(file);
+		return ret;
+	}
+
+	if ((dir = opendir(dir_path)) == NULL)
+	{
+		fprintf(stderr, "[ERROR] cannot open dir '%s' -- %s\n", dir_path, strerror(errno));
+		return -1;
+	}
+
+	// "dir/" doesn't need another '/'
+	if (dir_path[strlen(dir_path) - 1] != '/')
+		separator = "/";
+
+	while (1)
+	{
+		// readdir only sets errno on failure
+		errno = 0;
+		if ((dir_entry = readdir(dir)) == NULL)
+		{
+			if (errno)
+			{
+				fprintf(stderr, "[ERROR] cannot read from directory '%s' -- %s\n", dir_path, strerror(errno));
+				ret = -1;
+			}
+			break;
+		}
+
+		// +1 for the terminator '\0'
+		char *full_path = MALLOC(strlen(dir_path) + strlen(separator) + strlen(dir_entry->d_name) + 1);
+
+		if (full_path == NULL)
+		{
+			ret = -1;
+			break;
+		}
+
+		sprintf(full_path, "%s%s%s", dir_path, separator, dir_entry->d_name);
+
+		// Only regular files are compared
+		if (!stat(full_path, &st) && S_ISREG(st.st_mode) && addPath(corpus, full_path))
+			ret = -1;
+
+		FREE(full_path);
+
+		if (ret)
+			break;
+	}
+
+	closedir(dir);
+
+	return ret;
+}
+
+/**
+ * Runs both backends over a corpus and reports where they disagree
+ * @param corpus corpus
+ * @param threads number of worker threads
+ * @return number of disagreements or -1 when an error was detected
+ */
+int corpusProcessing(const struct corpus *corpus, int threads)
+{
+	const char *names[2] = {"file", "sniff"};
+	struct verdict *verdicts[2];
+	struct job job;
+	int disagreements = 0;
+	double wall, cpu;
+
+	verdicts[BACKEND_FILE] = MALLOC((corpus->count + 1) * sizeof(struct verdict));
+	verdicts[BACKEND_SNIFF] = MALLOC((corpus->count + 1) * sizeof(struct verdict));
+
+	if (verdicts[BACKEND_FILE] == NULL || verdicts[BACKEND_SNIFF] == NULL)
+	{
+		FREE(verdicts[BACKEND_FILE]);
+		FREE(verdicts[BACKEND_SNIFF]);
+		return -1;
+	}
+
+	pthread_mutex_init(&job.lock, NULL);
+	job.corpus = corpus;
+	job.count = corpus->count;
+
+	// Backends run one after the other so the CPU time of each can be measured
+	for (int backend = BACKEND_FILE; backend <= BACKEND_SNIFF; backend++)
+	{
+		job.backend = backend;
+		job.verdicts = verdicts[backend];
+
+		wall = wallTime();
+		cpu = cpuTime();
+
+		if (runJob(corpusWorker, &job, threads))
+		{
+			disagreements = -1;
+			break;
+		}
+
+		wall = wallTime() - wall;
+		cpu = cpuTime() - cpu;
+
+		printf("[BACKEND] %s: %zu files in %.3f s (%.1f files/s); CPU time %.3f s\n", names[backend], corpus->count, wall,
+			   wall > 0 ? corpus->count / wall : 0.0, cpu);
+	}
+
+	for (size_t i = 0; disagreements >= 0 && i < corpus->count; i++)
+		if (!agree(verdicts[BACKEND_FILE] + i, verdicts[BACKEND_SNIFF] + i))
+		{
+			printf("[DIFF] '%s': file '%s', sniff '%s'\n", corpus->paths[i], verdicts[BACKEND_FILE][i].mime_type,
+				   verdicts[BACKEND_SNIFF][i].mime_type);
+			disagreements++;
+		}
+
+	pthread_mutex_destroy(&job.lock);
+	FREE(verdicts[BACKEND_FILE]);
+	FREE(verdicts[BACKEND_SNIFF]);
+
+	return disagreements;
+}
+
+/**
+ * Runs both backends over mutated headers and reports where they disagree
+ * @param iterations number of mutated headers
+ * @param seed seed of the mutations
+ * @param threads number of worker threads
+ * @param compared where the number of headers given to both backends will be stored
+ * @return number of disagreements or -1 when an error was detected
+ */
+int fuzzProcessing(long iterations, unsigned long long seed, int threads, size_t *compared)
+{
+	struct sigaction act_info;
+	struct job job;
+	int ret;
+
+	// Crashes in the header parsing are reported with the iteration that caused them
+	memset(&act_info, 0, sizeof(act_info));
+	act_info.sa_handler = crashHandler;
+	act_info.sa_flags = SA_RESETHAND;
+	sigemptyset(&act_info.sa_mask);
+	sigaction(SIGSEGV, &act_info, NULL);
+	sigaction(SIGBUS, &act_info, NULL);
+	sigaction(SIGFPE, &act_info, NULL);
+	sigaction(SIGABRT, &act_info, NULL);
+
+	fuzz_seed = seed;
+	printf("[INFO] fuzzing %ld headers with --seed %llu\n", iterations, seed);
+
+	pthread_mutex_init(&job.lock, NULL);
+	job.count = (size_t)iterations;
+	job.seed = seed;
+	job.disagreements = 0;
+	job.compared = 0;
+	job.busy[BACKEND_FILE] = 0;
+	job.busy[BACKEND_SNIFF] = 0;
+
+	ret = runJob(fuzzWorker, &job, threads);
+
+	// Busy time is summed over the threads, so files/s is per thread
+	printf("[BACKEND] file: %zu headers; busy %.3f s (%.1f headers/s per thread)\n", job.compared, job.busy[BACKEND_FILE],
+		   job.busy[BACKEND_FILE] > 0 ? job.compared / job.busy[BACKEND_FILE] : 0.0);
+	printf("[BACKEND] sniff: %ld headers; busy %.3f s (%.1f headers/s per thread)\n", iterations, job.busy[BACKEND_SNIFF],
+		   job.busy[BACKEND_SNIFF] > 0 ? iterations / job.busy[BACKEND_SNIFF] : 0.0);
+
+	pthread_mutex_destroy(&job.lock);
+	*compared = job.compared;
+
+	return ret ? -1 : (int)job.disagreements;
+}
+
+int main(int argc, char *argv[])
+{
+	struct gengetopt_args_info args;
+	struct corpus corpus = {NULL, 0};
+	int disagreements;
+	size_t total = 0;
+
+	if (cmdline_parser(argc, argv, &args))
+	{
+		fprintf(stderr, "[ERROR] cmdline_parser\n");
+		return 1;
+	}
+
+	if (args.threads_arg < 1)
+	{
+		fprintf(stderr, "[ERROR] --threads must be bigger than 0\n");
+		cmdline_parser_free(&args);
+		return 1;
+	}
+
+	if (args.fuzz_given)
+		disagreements = fuzzProcessing(args.fuzz_arg > 0 ? args.fuzz_arg : 0,
+									   args.seed_given ? (unsigned long long)args.seed_arg : (unsigned long long)time(NULL), args.threads_arg, &total);
+	else if (loadCorpus(&corpus, args.dir_arg, args.batch_arg))
+		disagreements = -1;
+	else
+	{
+		total = corpus.count;
+		disagreements = corpusProcessing(&corpus, args.threads_arg);
+	}
+
+	if (disagreements >= 0)
+		printf("[SUMMARY] files compared: %zu; disagreements: %d\n", total, disagreements);
+
+	// Freeing allocated memory
+	for (size_t i = 0; i < corpus.count; i++)
+		FREE(corpus.paths[i]);
+	free(corpus.paths);
+	cmdline_parser_free(&args);
+
+	if (disagreements < 0)
+		return 2;
+
+	return disagreements ? 3 : 0;
+}
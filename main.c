@@ -13,10 +13,14 @@
 #include <string.h>
 #include <sys/wait.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include "args.h"
 #include "debug.h"
 #include "memory.h"
-#include "mime.h"
+#include "checkfile.h"
+#include "filter.h"
+#include "tar.h"
+#include "sample.h"
 
 // Global variables changed by batchProcessing and being read by signalProcessing
 // when program receives SIGUSR1 signal
@@ -24,15 +28,24 @@ int file_number = 0;
 char *file_name = NULL;
 time_t init_batch_time;
 
-int fileProcessing(char *file_path, int *summary);
-int dirProcessing(char *dir_path, int *summary);
-int batchProcessing(const char *batch_path, int *summary);
+// Cache of detected types shared by identical files, NULL without --dedup
+struct cf_dedup *dedup = NULL;
+
+int showResult(const char *file_path, int status, const struct cf_result *result, int *summary);
+int fileProcessing(const char *file_path, int *summary);
+int sampleProcessing(struct sampler *sampler, const char *file_path, int *summary);
+int dirProcessing(const char *dir_path, int *summary, const struct filter *filter, struct sampler *sampler);
+int batchProcessing(const char *batch_path, int *summary, struct sampler *sampler);
+int tarProcessing(const char *tar_path, int *summary);
 void showSummary(const int *summary);
+void showSampleSummary(const struct sampler *sampler, const int *summary);
 void signalProcessing(int signal, siginfo_t *siginfo, void *context);
 
 /**
- * Show summary of processed files
- * @param summary array with 3 positions (OK, MISMATCH, ERROR)
+ * Handles SIGQUIT and SIGUSR1, the latter shows the progress of --batch
+ * @param signal number of the signal received
+ * @param siginfo information about the sender of the signal
+ * @param context not used
  * @return Nothing returned
  */
 void signalProcessing(int signal, siginfo_t *siginfo, void *context)
@@ -62,11 +75,12 @@ void signalProcessing(int signal, siginfo_t *siginfo, void *context)
 
 /**
  * Show summary of processed files
- * @param summary array with 3 positions (OK, MISMATCH, ERROR)
+ * @param summary array with 4 positions (OK, MISMATCH, ERROR, FILTERED)
  * @return Nothing returned
  */
 void showSummary(const int *summary)
 {
+	unsigned long long lookups, hits;
 	int total = 0;
 
 	for (size_t i = 0; i < 3; i++)
@@ -76,139 +90,176 @@ void showSummary(const int *summary)
 
 	printf("[SUMMARY] files analyzed: %d; files OK: %d;", total, *summary);
 	printf(" Mismatch: %d;", *(summary + 1));
-	printf(" Errors: %d\n", *(summary + 2));
+	printf(" Errors: %d;", *(summary + 2));
+	printf(" Filtered: %d\n", *(summary + 3));
+
+	if (dedup != NULL)
+	{
+		cf_dedup_stats(dedup, &lookups, &hits);
+		printf("[DEDUP] lookups: %llu; hits: %llu (%.2f%%); type detections avoided: %llu\n", lookups, hits,
+			   lookups ? 100.0 * hits / lookups : 0.0, hits);
+	}
 }
 
 /**
- * Start of processing the file
+ * Shows the classification of a file and updates the summary
  * @param file_path path to the file
- * @param summary array with 3 positions (OK, MISMATCH, ERROR)
+ * @param status value returned by the classify functions
+ * @param result detected types of the file
+ * @param summary array with 4 positions (OK, MISMATCH, ERROR, FILTERED)
  * @return 	0 -> all ok;
  * 			-1 -> error detected
  */
-int fileProcessing(char *file_path, int *summary)
+int showResult(const char *file_path, int status, const struct cf_result *result, int *summary)
 {
-	// Checking file
-	FILE *fd = fopen(file_path, "r");
-	if (fd == NULL)
+	// Showing output information
+	switch (status)
 	{
-		fprintf(stderr, "[ERROR] cannot open file '%s' -- %s\n", file_path, strerror(errno));
+	case CF_OK:
+		printf("[OK] '%s': extension '%s' matches file type '%s'\n", file_path, result->file_extension, result->detected_extension);
+		(*summary)++;
+		return 0;
+
+	case CF_MISMATCH:
+		printf("[MISMATCH] '%s': extension is '%s', file type is '%s'\n", file_path, result->file_extension, result->detected_extension);
+		(*(summary + 1))++;
+		return 0;
+
+	case CF_UNSUPPORTED:
+		printf("[INFO] '%s': type '%s' is not supported by checkFile\n", file_path, result->mime_type);
+		return 0;
+
+	case CF_ERROR:
+		fprintf(stderr, "[ERROR] cannot open file '%s' -- %s\n", file_path, strerror(result->error));
 		(*(summary + 2))++;
+		return -1;
 
+	case CF_EMPTY:
+		printf("[INFO] '%s': empty file cannot be classified\n", file_path);
 		return -1;
-	}
 
-	fseek(fd, 0, SEEK_END);
+	case CF_NO_MIME:
+		printf("[INFO] '%s': not hable to detect mime type\n", file_path);
+		return -1;
 
-	// If file empty ftell will return 0
-	if (!ftell(fd))
-	{
-		printf("[INFO] '%s': empty file cannot be classified\n", file_path);
-		fclose(fd);
+	default:
+		printf("[INFO] '%s': file without extension\n", file_path);
 		return -1;
 	}
+}
 
-	char *mime_type = NULL;
-	char *file_extension = MALLOC(MAX_EXT_SIZE);
-	char *detected_extension = MALLOC(MAX_EXT_SIZE);
+/**
+ * Show the estimated rates of the population from the sampled files
+ * @param sampler sampler used to select the files
+ * @param summary array with 4 positions (OK, MISMATCH, ERROR, FILTERED) of the sampled files
+ * @return Nothing returned
+ */
+void showSampleSummary(const struct sampler *sampler, const int *summary)
+{
+	const char *labels[4] = {"OK", "Mismatch", "Errors", "Unclassified"};
+	int counts[4];
+	double low, high;
 
-	mime_type = mimeParsing(mime_type, file_path);
+	// Unsupported, empty and extensionless files, so the rates add up to 100%
+	counts[0] = *summary;
+	counts[1] = *(summary + 1);
+	counts[2] = *(summary + 2);
+	counts[3] = (int)sampler->taken - counts[0] - counts[1] - counts[2];
 
-	if (mime_type == NULL)
+	printf("[SAMPLE] files sampled: %llu of %llu (seed %llu)\n", sampler->taken, sampler->seen, sampler->seed);
+
+	for (size_t i = 0; i < 4; i++)
 	{
-		printf("[INFO] '%s': not hable to detect mime type\n", file_path);
-		fclose(fd);
-		FREE(detected_extension);
-		FREE(file_extension);
-		return -1;
+		sampleInterval(counts[i], sampler->taken, sampler->seen, &low, &high);
+		printf("[SAMPLE] %s: %.2f%% (95%% CI %.2f%%-%.2f%%), estimated %.0f files\n", labels[i],
+			   sampler->taken ? 100.0 * counts[i] / sampler->taken : 0.0, 100 * low, 100 * high,
+			   sampler->taken ? (double)counts[i] * sampler->seen / sampler->taken : 0.0);
 	}
+}
+
+/**
+ * Start of processing the file
+ * @param file_path path to the file
+ * @param summary array with 4 positions (OK, MISMATCH, ERROR, FILTERED)
+ * @return 	0 -> all ok;
+ * 			-1 -> error detected
+ */
+int fileProcessing(const char *file_path, int *summary)
+{
+	struct cf_result result;
+
+	return showResult(file_path, classify_path_dedup(dedup, file_path, &result), &result, summary);
+}
 
-	if (getFileExtension(file_extension, file_path))
+/**
+ * Offers a file to the sampler and analyzes it if selected. When
+ * file_path is NULL the files kept in the reservoir are analyzed
+ * @param sampler sampler used to select the files
+ * @param file_path path to the file or NULL
+ * @param summary array with 4 positions (OK, MISMATCH, ERROR, FILTERED)
+ * @return 	0 -> all ok;
+ * 			-1 -> not hable to allocate memory
+ */
+int sampleProcessing(struct sampler *sampler, const char *file_path, int *summary)
+{
+	if (file_path == NULL)
 	{
-		printf("[INFO] '%s': file without extension\n", file_path);
-		fclose(fd);
-		FREE(detected_extension);
-		FREE(file_extension);
-		FREE(mime_type);
-		return -1;
+		for (size_t i = 0; i < sampler->stored; i++)
+			fileProcessing(sampler->reservoir[i], summary);
+		return 0;
 	}
 
-	// Showing output information
-	switch (mimeValidation(mime_type, file_extension, detected_extension))
+	switch (sampleOffer(sampler, file_path))
 	{
-	case 0:
-		printf("[OK] '%s': extension '%s' matches file type '%s'\n", file_path, file_extension, detected_extension);
-		(*summary)++;
-		break;
+	case 1:
+		fileProcessing(file_path, summary);
+		return 0;
 
 	case -1:
-		printf("[MISMATCH] '%s': extension is '%s', file type is '%s'\n", file_path, file_extension, detected_extension);
-		(*(summary + 1))++;
-		break;
-
-	case -2:
-		printf("[INFO] '%s': type '%s' is not supported by checkFile\n", file_path, mime_type);
-		break;
+		fprintf(stderr, "[ERROR] cannot allocate memory\n");
+		return -1;
 
 	default:
-		printf("[INFO] '%s': type '%s' is not supported by checkFile\n", file_path, mime_type);
-		break;
+		return 0;
 	}
-
-	// Freeing memory
-	fclose(fd);
-	FREE(detected_extension);
-	FREE(file_extension);
-	FREE(mime_type);
-
-	return 0;
 }
 
 /**
  * Analysing the directory files
  * @param dir_path string to the directory
- * @param summary array with 3 positions (OK, MISMATCH, ERROR)
+ * @param summary array with 4 positions (OK, MISMATCH, ERROR, FILTERED)
+ * @param filter compiled include/exclude filter, evaluated before opening each entry
+ * @param sampler sampler that selects the entries to analyze
  * @return 	0 -> all ok;
  * 			-1 -> error detected
  */
-int dirProcessing(char *dir_path, int *summary)
+int dirProcessing(const char *dir_path, int *summary, const struct filter *filter, struct sampler *sampler)
 {
 	DIR *dir = opendir(dir_path);
 	struct dirent *dir_entry;
 	int stop = 0;
 	char *full_path = NULL;
+	const char *separator = "";
 
 	// Checking dir
 	if (dir == NULL)
 	{
 		fprintf(stderr, "[ERROR] cannot open dir '%s' -- %s\n", dir_path, strerror(errno));
-		exit(2);
+		return -1;
 	}
 
 	// Checking last char of dir_path
-	// Using values of ASCII table to avoid calling strcomp
-	if ((int)dir_path[strlen(dir_path) - 1] != (int)'/')
-	{
-		// Adding space for '/' to the string
-		dir_path = realloc(dir_path, 1);
+	// if the dir doesn't have the / char the path to the file will not be successful
+	if (dir_path[strlen(dir_path) - 1] != '/')
+		separator = "/";
 
-		// Returning because if the dir doesn't have the / char the path to the file will
-		// not be successful
-		if (dir_path == NULL)
-		{
-			closedir(dir);
-			fprintf(stderr, "[ERROR] not hable to allocate memory\n");
-			exit(3);
-		}
-
-		strcat(dir_path, "/");
-	}
-
-	printf("[INFO] analyzing files of directory '%s'\n", dir_path);
+	printf("[INFO] analyzing files of directory '%s%s'\n", dir_path, separator);
 
 	// Read from dir
 	while (!stop)
 	{
+		// readdir only sets errno on failure
+		errno = 0;
 		dir_entry = readdir(dir);
 		if (dir_entry == NULL)
 		{
@@ -216,27 +267,35 @@ int dirProcessing(char *dir_path, int *summary)
 			{
 				fprintf(stderr, "[ERROR] cannot read from directory '%s' -- %s\n", dir_path, strerror(errno));
 				closedir(dir);
-				exit(4);
+				return -1;
 			}
 			else
 				stop = 1;
 		}
+		// '.' and '..' aren't files of the directory
+		else if (!strcmp(dir_entry->d_name, ".") || !strcmp(dir_entry->d_name, ".."))
+			continue;
+		else if (filterSkip(filter, dirfd(dir), dir_entry))
+			(*(summary + 3))++;
 		else
 		{
 			// +1 for the terminator '\0'
-			full_path = MALLOC(strlen(dir_path) + strlen(dir_entry->d_name) + 1);
+			full_path = MALLOC(strlen(dir_path) + strlen(separator) + strlen(dir_entry->d_name) + 1);
 			if (full_path == NULL)
 			{
 				fprintf(stderr, "[ERROR] cannot allocate memory\n");
 				closedir(dir);
-				exit(5);
+				return -1;
 			}
 
 			// Initializing 'full_path'
-			memset(full_path, '\0', 1);
-			strcat(full_path, dir_path);
-			strcat(full_path, (dir_entry->d_name));
-			fileProcessing(full_path, summary);
+			sprintf(full_path, "%s%s%s", dir_path, separator, dir_entry->d_name);
+			if (sampleProcessing(sampler, full_path, summary))
+			{
+				FREE(full_path);
+				closedir(dir);
+				return -1;
+			}
 			FREE(full_path);
 		}
 	}
@@ -249,18 +308,19 @@ int dirProcessing(char *dir_path, int *summary)
 /**
  * Analysing the files listed inside btachPath
  * @param btachPath string to the file
- * @param summary array with 3 positions (OK, MISMATCH, ERROR)
+ * @param summary array with 4 positions (OK, MISMATCH, ERROR, FILTERED)
+ * @param sampler sampler that selects the files to analyze
  * @return 	0 -> all ok;
  * 			-1 -> error detected
  */
-int batchProcessing(const char *batch_path, int *summary)
+int batchProcessing(const char *batch_path, int *summary, struct sampler *sampler)
 {
 	FILE *file = fopen(batch_path, "r");
 
 	if (file == NULL)
 	{
 		fprintf(stderr, "[ERROR] cannot open file '%s' -- %s\n", batch_path, strerror(errno));
-		exit(4);
+		return -1;
 	}
 
 	char *file_to_val = MALLOC(MAX_FILENAME_SIZE);
@@ -269,7 +329,7 @@ int batchProcessing(const char *batch_path, int *summary)
 	if (file_to_val == NULL)
 	{
 		fclose(file);
-		exit(5);
+		return -1;
 	}
 
 	time(&init_batch_time);
@@ -298,7 +358,12 @@ int batchProcessing(const char *batch_path, int *summary)
 				strtok(file_to_val, "\n");
 
 			file_number++;
-			fileProcessing(file_to_val, summary);
+			if (sampleProcessing(sampler, file_to_val, summary))
+			{
+				fclose(file);
+				FREE(file_to_val);
+				return -1;
+			}
 		}
 	}
 	fclose(file);
@@ -307,11 +372,71 @@ int batchProcessing(const char *batch_path, int *summary)
 	return 0;
 }
 
+/**
+ * Analysing the members of a tar archive, in a single pass. Only the first
+ * bytes of each member are read, the rest is skipped
+ * @param tar_path path to the tar archive or "-" for stdin
+ * @param summary array with 4 positions (OK, MISMATCH, ERROR, FILTERED)
+ * @return 	0 -> all ok;
+ * 			-1 -> error detected
+ */
+int tarProcessing(const char *tar_path, int *summary)
+{
+	struct tar_reader reader;
+	struct tar_member member;
+	struct cf_result result;
+	unsigned char header[CF_HEADER_SIZE];
+	char file_extension[MAX_EXT_SIZE];
+	long long length;
+	int ret;
+	int fd = STDIN_FILENO;
+
+	if (strcmp(tar_path, "-") && (fd = open(tar_path, O_RDONLY)) == -1)
+	{
+		fprintf(stderr, "[ERROR] cannot open file '%s' -- %s\n", tar_path, strerror(errno));
+		return -1;
+	}
+
+	printf("[INFO] analyzing members of tar archive '%s'\n", tar_path);
+	tarInit(&reader, fd);
+
+	while ((ret = tarNext(&reader, &member)) == 1)
+	{
+		if (!member.is_file)
+			continue;
+
+		if ((length = tarReadData(&reader, header, CF_HEADER_SIZE)) < 0)
+		{
+			ret = (int)length;
+			break;
+		}
+
+		if (getFileExtension(file_extension, member.name))
+			file_extension[0] = '\0';
+
+		showResult(member.name, classify_buffer(header, (size_t)length, file_extension, &result), &result, summary);
+	}
+
+	if (ret == -1)
+		fprintf(stderr, "[ERROR] cannot read from tar archive '%s' -- %s\n", tar_path, strerror(errno));
+	else if (ret == -2)
+		fprintf(stderr, "[ERROR] invalid or truncated tar archive '%s'\n", tar_path);
+
+	if (fd != STDIN_FILENO)
+		close(fd);
+
+	return ret ? -1 : 0;
+}
+
 int main(int argc, char *argv[])
 {
 	struct sigaction act_info;
 	struct gengetopt_args_info args;
-	int summary[3] = {0};
+	int summary[4] = {0};
+	int ret = 0;
+	struct filter filter;
+	struct sampler sampler;
+	int sample_mode = SAMPLE_NONE;
 
 	if (cmdline_parser(argc, argv, &args))
 		ERROR(1, "Error: cmdline_parser\n");
@@ -333,6 +458,70 @@ int main(int argc, char *argv[])
 	if (sigaction(SIGUSR1, &act_info, NULL) < 0)
 		ERROR(3, "Sigaction creation\n");
 
+	if (args.min_size_given && args.max_size_given && args.min_size_arg > args.max_size_arg)
+	{
+		fprintf(stderr, "[ERROR] --min-size can't be bigger than --max-size\n");
+		cmdline_parser_free(&args);
+		return 1;
+	}
+
+	if (args.sample_given && args.sample_count_given)
+	{
+		fprintf(stderr, "[ERROR] --sample and --sample-count can't be used together\n");
+		cmdline_parser_free(&args);
+		return 1;
+	}
+
+	if (args.sample_given)
+	{
+		if (args.sample_arg <= 0 || args.sample_arg > 1)
+		{
+			fprintf(stderr, "[ERROR] --sample must be between 0 (excluded) and 1\n");
+			cmdline_parser_free(&args);
+			return 1;
+		}
+		sample_mode = SAMPLE_PROBABILITY;
+	}
+
+	if (args.sample_count_given)
+	{
+		if (args.sample_count_arg <= 0)
+		{
+			fprintf(stderr, "[ERROR] --sample-count must be bigger than 0\n");
+			cmdline_parser_free(&args);
+			return 1;
+		}
+		sample_mode = SAMPLE_COUNT;
+	}
+
+	if (sampleInit(&sampler, sample_mode, args.sample_given ? args.sample_arg : 1,
+				   args.sample_count_given ? (size_t)args.sample_count_arg : 0,
+				   args.seed_given ? (unsigned long long)args.seed_arg : (unsigned long long)time(NULL) ^ (unsigned long long)getpid()))
+	{
+		fprintf(stderr, "[ERROR] not hable to allocate memory\n");
+		cmdline_parser_free(&args);
+		return 5;
+	}
+
+	if (args.dedup_flag && (dedup = cf_dedup_create(0)) == NULL)
+	{
+		fprintf(stderr, "[ERROR] not hable to allocate memory\n");
+		sampleFree(&sampler);
+		cmdline_parser_free(&args);
+		return 5;
+	}
+
+	// Patterns are compiled once, before any directory is read
+	if (filterCompile(&filter, args.include_arg, args.include_given, args.exclude_arg, args.exclude_given,
+					  args.min_size_given ? args.min_size_arg : -1, args.max_size_given ? args.max_size_arg : -1))
+	{
+		fprintf(stderr, "[ERROR] not hable to allocate memory\n");
+		cf_dedup_free(dedup);
+		sampleFree(&sampler);
+		cmdline_parser_free(&args);
+		return 5;
+	}
+
 	// Individual File Processing start
 	if (args.files_given > 0)
 		for (size_t i = 0; i < args.files_given; i++)
@@ -341,19 +530,38 @@ int main(int argc, char *argv[])
 	// Directory Processing start
 	if (args.dir_given > 0)
 	{
-		dirProcessing(args.dir_arg, summary);
-		showSummary(summary);
+		if (dirProcessing(args.dir_arg, summary, &filter, &sampler) || sampleProcessing(&sampler, NULL, summary))
+			ret = 2;
+		else
+			showSummary(summary);
 	}
 
 	// Batch File Processing start
 	if (args.batch_given > 0)
 	{
-		batchProcessing(args.batch_arg, summary);
-		showSummary(summary);
+		if (batchProcessing(args.batch_arg, summary, &sampler) || sampleProcessing(&sampler, NULL, summary))
+			ret = 4;
+		else
+			showSummary(summary);
+	}
+
+	if (sample_mode != SAMPLE_NONE && ret == 0 && (args.dir_given || args.batch_given))
+		showSampleSummary(&sampler, summary);
+
+	// Tar Archive Processing start
+	if (args.tar_given > 0)
+	{
+		if (tarProcessing(args.tar_arg, summary))
+			ret = 6;
+		else
+			showSummary(summary);
 	}
 
 	// Freeing allocated memory
+	filterFree(&filter);
+	sampleFree(&sampler);
+	cf_dedup_free(dedup);
 	cmdline_parser_free(&args);
 
-	return 0;
+	return ret;
 }
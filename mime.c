@@ -5,25 +5,25 @@
  * @author Ricardo dos Santos Franco 2202314
  */
 
+#include <ctype.h>
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <sys/wait.h>
-#include "debug.h"
-#include "memory.h"
 #include "mime.h"
 
 /**
  * Gets the file extension
- * @param file_extension string where the extension will be copied
+ * @param file_extension string with MAX_EXT_SIZE bytes where the extension will be copied
  * @param file_path path to the file
  * @return	0 -> extension was detected;
  * 			-1 -> extension not detected
  */
-int getFileExtension(char *file_extension, char *file_path)
+int getFileExtension(char *file_extension, const char *file_path)
 {
-    char *ptr;
+    const char *ptr;
 
     // returns ptr if found '/' or NULL if not
     ptr = strrchr(file_path, (int)'/');
@@ -36,7 +36,8 @@ int getFileExtension(char *file_extension, char *file_path)
         return -1;
 
     // I want what's after the '.' character so +1
-    strcpy(file_extension, ptr + 1);
+    // Longer extensions are truncated, none of the supported ones is that long
+    snprintf(file_extension, MAX_EXT_SIZE, "%s", ptr + 1);
 
     return 0;
 }
@@ -45,21 +46,99 @@ int getFileExtension(char *file_extension, char *file_path)
  * Extracts the original file type and stores the output inside output_file
  * @param output_file pointer to FILE struct where file type of file_path will be stored
  * @param file_path path to the file
- * @return Nothing returned
+ * @return	0 -> "file" program was executed;
+ * 			-1 -> not hable to create the child process
  */
-void extractMimeTypeTo(FILE *output_file, const char *file_path)
+int extractMimeTypeTo(FILE *output_file, const char *file_path)
 {
+    // Prepared before fork, the parent may have other threads and the child
+    // should only call dup2, exec, write and _exit
+    int output_fd = fileno(output_file);
+    char *argv[] = {"file", "--mime-type", (char *)file_path, NULL};
+    pid_t pid = fork();
+
+    if (pid == -1)
+        return -1;
+
     // Creates child process
-    if (fork() == 0)
+    if (pid == 0)
+    {
+        // Redirecting the child output to output_file
+        dup2(output_fd, STDOUT_FILENO);
+        execvp(argv[0], argv);
+
+        write(STDERR_FILENO, EXEC_ERROR_MSG, sizeof(EXEC_ERROR_MSG) - 1);
+        _exit(127);
+    }
+
+    // Parent waits only for its own child so other children aren't reaped
+    while (waitpid(pid, NULL, 0) == -1)
+        if (errno != EINTR)
+            return -1;
+
+    return 0;
+}
+
+/**
+ * Detects the mime type from the first bytes of a file, without
+ * executing the "file" program
+ * @param buffer first bytes of the file
+ * @param length number of bytes in buffer
+ * @return 	mime type of the supported file types, "text/plain" or
+ * 			"application/octet-stream"
+ */
+const char *mimeSniff(const unsigned char *buffer, size_t length)
+{
+    // Tags that mark the begining of a html document
+    const char *html_tags[] = {"<!doctype html", "<html", "<head", "<title", "<body", "<script"};
+    // ISO base media major brands reported as mp4
+    const char *mp4_brands[] = {"isom", "iso2", "iso4", "iso5", "iso6", "mp41", "mp42", "avc1"};
+    size_t i = 0;
+
+    if (length >= 5 && !memcmp(buffer, "%PDF-", 5))
+        return "application/pdf";
+
+    if (length >= 6 && (!memcmp(buffer, "GIF87a", 6) || !memcmp(buffer, "GIF89a", 6)))
+        return "image/gif";
+
+    if (length >= 3 && !memcmp(buffer, "\xff\xd8\xff", 3))
+        return "image/jpeg";
+
+    if (length >= 8 && !memcmp(buffer, "\x89PNG\r\n\x1a\n", 8))
+        return "image/png";
+
+    if (length >= 6 && !memcmp(buffer, "7z\xbc\xaf\x27\x1c", 6))
+        return "application/x-7z-compressed";
+
+    if (length >= 12 && !memcmp(buffer + 4, "ftyp", 4))
+        for (size_t j = 0; j < sizeof(mp4_brands) / sizeof(mp4_brands[0]); j++)
+            if (!memcmp(buffer + 8, mp4_brands[j], 4))
+                return "video/mp4";
+
+    // Skipping UTF-8 BOM and white spaces before looking for html tags
+    if (length >= 3 && !memcmp(buffer, "\xef\xbb\xbf", 3))
+        i = 3;
+    while (i < length && isspace(buffer[i]))
+        i++;
+
+    for (size_t j = 0; j < sizeof(html_tags) / sizeof(html_tags[0]); j++)
     {
-        // Redirecting the child output to out.txt
-        dup2(fileno(output_file), STDOUT_FILENO);
-        if (execlp("file", "file", "--mime-type", file_path, NULL))
-            ERROR(2, "Error executing 'file' bash program -- ");
+        size_t tag_length = strlen(html_tags[j]);
+        size_t k = 0;
+
+        while (k < tag_length && i + k < length && tolower(buffer[i + k]) == html_tags[j][k])
+            k++;
+
+        if (k == tag_length)
+            return "text/html";
     }
-    else
-        // Parent waits for Child
-        wait(NULL);
+
+    // Control characters other than white spaces mean binary data
+    for (i = 0; i < length; i++)
+        if (buffer[i] < 0x20 && !isspace(buffer[i]) && buffer[i] != 0x1b)
+            return "application/octet-stream";
+
+    return "text/plain";
 }
 
 /**
@@ -113,47 +192,39 @@ int mimeValidation(const char *mime_type, const char *file_extension, char *dete
 /**
  * Analyzes the mime of file_path
  * @param mime_type string where the mime type detected by the bash program "file" will be stored
+ * @param size number of bytes of mime_type
  * @param file_path path to the file
- * @return 	pointer to memory for string with the mime type or NULL
+ * @return 	0 -> mime type detected;
+ * 			-1 -> not hable to detect mime type
  */
-char *mimeParsing(char *mime_type, const char *file_path)
+int mimeParsing(char *mime_type, size_t size, const char *file_path)
 {
-    FILE *output_file = fopen(OUTPUT_FILENAME, "w+");
+    // tmpfile has an unique name, so concurrent calls won't share the output
+    FILE *output_file = tmpfile();
+    char *line = NULL;
+    size_t line_size = 0;
+    char *ptr;
+    int ret = -1;
 
     if (output_file == NULL)
-        return NULL;
-
-    char string[MAX_FILENAME_SIZE];
-
-    extractMimeTypeTo(output_file, file_path);
-
-    // saves the file size in bytes
-    size_t file_size = lseek(fileno(output_file), 0, SEEK_END);
-
-    lseek(fileno(output_file), 0, SEEK_SET);
-
-    mime_type = MALLOC(file_size * sizeof(char));
+        return -1;
 
-    if (mime_type == NULL)
+    if (!extractMimeTypeTo(output_file, file_path))
     {
-        fclose(output_file);
-        fprintf(stderr, "[ERROR] not hable to allocate memory\n");
-        exit(2);
-    }
+        rewind(output_file);
 
-    // gets the fist line
-    fgets(mime_type, (int)file_size, output_file);
+        // gets the fist line "<file_path>: <mime_type>"
+        // Find the last occurence of ':' and adds 2 so mime_type wont have ': '
+        if (getline(&line, &line_size, output_file) > 0 && (ptr = strrchr(line, ':')) != NULL && ptr[1] != '\0')
+        {
+            ptr[strcspn(ptr, "\n")] = '\0';
+            snprintf(mime_type, size, "%s", ptr + 2);
+            ret = 0;
+        }
+    }
 
-    // Using aux string so source and destination of strcpy won't overlap.
-    // Find the last occurence of ':' and adds 2
-    // so mime_type wont have ': '
-    strcpy(string, strrchr(mime_type, ':') + 2);
-    strcpy(mime_type, string);
+    free(line);
     fclose(output_file);
 
-    // not verifying if file was successful removed because I don't want to notify
-    // the user about that
-    remove(OUTPUT_FILENAME);
-
-    return mime_type;
+    return ret;
 }
@@ -4,12 +4,21 @@
  * @author Ricardo dos Santos Franco 2202314
  */
 
+#ifndef MIME_H
+#define MIME_H
+
+#include <stdio.h>
+
 #define EXT_NUMBER 7
-#define OUTPUT_FILENAME "out.txt"
 #define MAX_EXT_SIZE 30
+#define MAX_MIME_SIZE 100
 #define MAX_FILENAME_SIZE 100
+#define EXEC_ERROR_MSG "Error executing 'file' bash program\n"
 
-int getFileExtension(char *file_extension, char *file_path);
-void extractMimeTypeTo(FILE *output_file, const char *file_path);
+int getFileExtension(char *file_extension, const char *file_path);
+int extractMimeTypeTo(FILE *output_file, const char *file_path);
+const char *mimeSniff(const unsigned char *buffer, size_t length);
 int mimeValidation(const char *mime_type, const char *file_extension, char *detected_extension);
-char *mimeParsing(char *mime_type, const char *file_path);
\ No newline at end of file
+int mimeParsing(char *mime_type, size_t size, const char *file_path);
+
+#endif /* MIME_H */
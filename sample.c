@@ -0,0 +1,174 @@
+/**
+ * @file sample.c
+ * @brief Random sampling of the files to be analyzed
+ *
+ * SAMPLE_PROBABILITY keeps each file with probability p as it is listed.
+ * SAMPLE_COUNT keeps an uniform sample of N files with reservoir sampling
+ * (algorithm R), without knowing beforehand how many files there are.
+ * @date 2021-10-5
+ * @author Ricardo dos Santos Franco 2202314
+ */
+
+#include <math.h>
+#include <string.h>
+#include "memory.h"
+#include "sample.h"
+
+/**
+ * Generates the next pseudo-random number (xorshift64*)
+ * @param sampler sampler holding the generator state
+ * @return random number between 0 and 1 (excluded)
+ */
+static double nextRandom(struct sampler *sampler)
+{
+    sampler->state ^= sampler->state >> 12;
+    sampler->state ^= sampler->state << 25;
+    sampler->state ^= sampler->state >> 27;
+
+    // The 53 most significant bits fill the mantissa of a double
+    return ((sampler->state * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Initializes a sampler
+ * @param sampler sampler to initialize
+ * @param mode SAMPLE_NONE, SAMPLE_PROBABILITY or SAMPLE_COUNT
+ * @param probability probability of keeping each file (SAMPLE_PROBABILITY)
+ * @param count number of files to keep (SAMPLE_COUNT)
+ * @param seed seed of the random generator, the same seed gives the same sample
+ * @return 	0 -> all ok;
+ * 			-1 -> not hable to allocate memory
+ */
+int sampleInit(struct sampler *sampler, int mode, double probability, size_t count, unsigned long long seed)
+{
+    sampler->mode = mode;
+    sampler->probability = probability;
+    sampler->count = count;
+    sampler->seed = seed;
+    // xorshift state can't be 0
+    sampler->state = seed ? seed : 0x9e3779b97f4a7c15ULL;
+    sampler->reservoir = NULL;
+    sampler->stored = 0;
+    sampler->seen = 0;
+    sampler->taken = 0;
+
+    if (mode == SAMPLE_COUNT && count > 0)
+    {
+        sampler->reservoir = MALLOC(count * sizeof(char *));
+        if (sampler->reservoir == NULL)
+            return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Offers a file to the sampler
+ * @param sampler sampler
+ * @param path path to the file, copied when kept in the reservoir
+ * @return 	1 -> file must be analyzed now;
+ * 			0 -> file not selected or kept in the reservoir;
+ * 			-1 -> not hable to allocate memory
+ */
+int sampleOffer(struct sampler *sampler, const char *path)
+{
+    char *copy;
+    size_t slot;
+
+    sampler->seen++;
+
+    if (sampler->mode == SAMPLE_NONE || (sampler->mode == SAMPLE_PROBABILITY && nextRandom(sampler) < sampler->probability))
+    {
+        sampler->taken++;
+        return 1;
+    }
+
+    if (sampler->mode != SAMPLE_COUNT || sampler->count == 0)
+        return 0;
+
+    // The first N files fill the reservoir, the i-th file after that
+    // replaces a random one with probability N/i
+    if (sampler->stored < sampler->count)
+        slot = sampler->stored;
+    else
+    {
+        slot = (size_t)(nextRandom(sampler) * (double)sampler->seen);
+        if (slot >= sampler->count)
+            return 0;
+    }
+
+    // +1 for the terminator '\0'
+    copy = MALLOC(strlen(path) + 1);
+    if (copy == NULL)
+        return -1;
+
+    strcpy(copy, path);
+
+    if (slot == sampler->stored)
+    {
+        sampler->stored++;
+        sampler->taken++;
+    }
+    else
+        FREE(sampler->reservoir[slot]);
+
+    sampler->reservoir[slot] = copy;
+
+    return 0;
+}
+
+/**
+ * Computes the Wilson score interval (95%) of a proportion, with the finite
+ * population correction: the interval shrinks as the sample gets closer to
+ * the whole population and is exact when every file was sampled
+ * @param hits number of files with the outcome
+ * @param total number of files in the sample
+ * @param population number of files the sample was taken from
+ * @param low where the lower bound (0 to 1) will be stored
+ * @param high where the upper bound (0 to 1) will be stored
+ * @return Nothing returned
+ */
+void sampleInterval(int hits, unsigned long long total, unsigned long long population, double *low, double *high)
+{
+    double n = (double)total;
+    double p;
+    double z = SAMPLE_Z;
+    double z2;
+    double center;
+    double margin;
+
+    if (total == 0)
+    {
+        *low = 0;
+        *high = 1;
+        return;
+    }
+
+    // Scaling z by sqrt((N - n) / (N - 1)) also moves the center back to p
+    if (population <= total)
+        z = 0;
+    else
+        z *= sqrt((double)(population - total) / (double)(population - 1));
+
+    z2 = z * z;
+    p = hits / n;
+    center = (p + z2 / (2 * n)) / (1 + z2 / n);
+    margin = z * sqrt(p * (1 - p) / n + z2 / (4 * n * n)) / (1 + z2 / n);
+
+    *low = center - margin < 0 ? 0 : center - margin;
+    *high = center + margin > 1 ? 1 : center + margin;
+}
+
+/**
+ * Frees the paths kept in the reservoir
+ * @param sampler sampler
+ * @return Nothing returned
+ */
+void sampleFree(struct sampler *sampler)
+{
+    for (size_t i = 0; i < sampler->stored; i++)
+        FREE(sampler->reservoir[i]);
+
+    FREE(sampler->reservoir);
+    sampler->stored = 0;
+}
@@ -0,0 +1,41 @@
+/**
+ * @file sample.h
+ * @brief Random sampling of the files to be analyzed
+ * @date 2021-10-5
+ * @author Ricardo dos Santos Franco 2202314
+ */
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <stddef.h>
+
+// Sampling modes
+#define SAMPLE_NONE 0
+#define SAMPLE_PROBABILITY 1
+#define SAMPLE_COUNT 2
+
+// z value of the 95% confidence intervals
+#define SAMPLE_Z 1.96
+
+struct sampler
+{
+    int mode;
+    double probability;
+    size_t count;
+    unsigned long long seed;
+    unsigned long long state;
+    // paths kept by reservoir sampling (SAMPLE_COUNT)
+    char **reservoir;
+    size_t stored;
+    // files offered and files selected to be analyzed
+    unsigned long long seen;
+    unsigned long long taken;
+};
+
+int sampleInit(struct sampler *sampler, int mode, double probability, size_t count, unsigned long long seed);
+int sampleOffer(struct sampler *sampler, const char *path);
+void sampleInterval(int hits, unsigned long long total, unsigned long long population, double *low, double *high);
+void sampleFree(struct sampler *sampler);
+
+#endif /* SAMPLE_H */
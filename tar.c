@@ -0,0 +1,517 @@
+/**
+ * @file tar.c
+ * @brief Single pass reader of tar (ustar/pax) streams
+ *
+ * The stream is only read forward, so it can come from a pipe. Member data
+ * is never buffered: the caller reads the bytes it needs and the rest is
+ * skipped by the next call to tarNext.
+ * @date 2021-10-5
+ * @author Ricardo dos Santos Franco 2202314
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "memory.h"
+#include "tar.h"
+
+// Offsets and sizes of the header fields (POSIX ustar format)
+#define TAR_NAME 0
+#define TAR_NAME_SIZE 100
+#define TAR_SIZE 124
+#define TAR_SIZE_SIZE 12
+#define TAR_CHKSUM 148
+#define TAR_CHKSUM_SIZE 8
+#define TAR_TYPEFLAG 156
+#define TAR_MAGIC 257
+#define TAR_PREFIX 345
+#define TAR_PREFIX_SIZE 155
+
+// Size of the buffer used to discard member data
+#define TAR_SKIP_SIZE 8192
+
+/**
+ * Reads size bytes, unless the end of the stream is reached
+ * @param fd file descriptor of the stream
+ * @param buffer memory where the bytes will be stored
+ * @param size number of bytes to read
+ * @return 	number of bytes read (less than size at the end of the stream);
+ * 			-1 -> error reading
+ */
+static long long readFull(int fd, void *buffer, long long size)
+{
+    long long total = 0;
+    ssize_t n;
+
+    while (total < size)
+    {
+        n = read(fd, (char *)buffer + total, (size_t)(size - total));
+
+        if (n == -1 && errno == EINTR)
+            continue;
+
+        if (n == -1)
+            return -1;
+
+        if (n == 0)
+            break;
+
+        total += n;
+    }
+
+    return total;
+}
+
+/**
+ * Discards size bytes of the stream
+ * @param fd file descriptor of the stream
+ * @param size number of bytes to discard
+ * @return 	0 -> all ok;
+ * 			-1 -> error reading;
+ * 			-2 -> stream ended before size bytes
+ */
+static int skipBytes(int fd, long long size)
+{
+    char buffer[TAR_SKIP_SIZE];
+    struct stat st;
+    long long n;
+    off_t offset;
+
+    // Seekable streams (stdin redirected from a file) don't need to be read,
+    // but lseek succeeds past the end of a truncated archive
+    if (size > 0 && (offset = lseek(fd, (off_t)size, SEEK_CUR)) != -1)
+    {
+        if (!fstat(fd, &st) && S_ISREG(st.st_mode) && offset > st.st_size)
+            return -2;
+        return 0;
+    }
+
+    while (size > 0)
+    {
+        n = readFull(fd, buffer, size < TAR_SKIP_SIZE ? size : TAR_SKIP_SIZE);
+
+        if (n == -1)
+            return -1;
+
+        if (n == 0)
+            return -2;
+
+        size -= n;
+    }
+
+    return 0;
+}
+
+/**
+ * Converts a numeric header field, written in octal or in base-256 (GNU
+ * extension for sizes bigger than 8GB)
+ * @param field first byte of the field
+ * @param size number of bytes of the field
+ * @param value where the number will be stored
+ * @return 	0 -> all ok;
+ * 			-1 -> invalid field
+ */
+static int parseNumber(const unsigned char *field, size_t size, long long *value)
+{
+    size_t i = 0;
+
+    *value = 0;
+
+    if (field[0] & 0x80)
+    {
+        // Negative values (0xff) make no sense for sizes
+        if (field[0] == 0xff)
+            return -1;
+
+        *value = field[0] & 0x7f;
+        for (i = 1; i < size; i++)
+        {
+            if (*value > (0x7fffffffffffffffLL >> 8))
+                return -1;
+            *value = (*value << 8) | field[i];
+        }
+
+        return 0;
+    }
+
+    while (i < size && field[i] == ' ')
+        i++;
+
+    for (; i < size && field[i] >= '0' && field[i] <= '7'; i++)
+    {
+        if (*value > (0x7fffffffffffffffLL >> 3))
+            return -1;
+        *value = (*value << 3) | (field[i] - '0');
+    }
+
+    // Numbers end with a space or '\0'
+    if (i < size && field[i] != ' ' && field[i] != '\0')
+        return -1;
+
+    return 0;
+}
+
+/**
+ * Verifies the checksum of a header block
+ * @param block header block
+ * @return 	0 -> valid checksum;
+ * 			-1 -> invalid checksum
+ */
+static int verifyChecksum(const unsigned char *block)
+{
+    long long expected;
+    long long unsigned_sum = 0;
+    long long signed_sum = 0;
+
+    if (parseNumber(block + TAR_CHKSUM, TAR_CHKSUM_SIZE, &expected))
+        return -1;
+
+    // The checksum field is summed as if it was filled with spaces
+    for (size_t i = 0; i < TAR_BLOCK_SIZE; i++)
+    {
+        int byte = i >= TAR_CHKSUM && i < TAR_CHKSUM + TAR_CHKSUM_SIZE ? ' ' : block[i];
+
+        unsigned_sum += byte;
+        signed_sum += (signed char)byte;
+    }
+
+    // Old tar implementations used signed chars
+    if (expected != unsigned_sum && expected != signed_sum)
+        return -1;
+
+    return 0;
+}
+
+/**
+ * Parses the complete records ("<length> <key>=<value>\n") of a part of a
+ * pax extended header, keeping the path and size of the next member
+ * @param reader tar reader
+ * @param data part of the extended header, terminated by '\0'
+ * @param size number of bytes of data
+ * @param pending where the length of the incomplete record at the end of
+ * 			data is stored, 0 when its length is incomplete too, -1 when the
+ * 			records ended before the end of the header
+ * @return 	number of bytes of the complete records;
+ * 			-2 -> invalid record
+ */
+static long long parsePax(struct tar_reader *reader, char *data, long long size, long long *pending)
+{
+    char *ptr = data;
+    char *end = data + size;
+
+    *pending = 0;
+
+    while (ptr < end)
+    {
+        char *key;
+        char *value;
+        char *record_end;
+        long length;
+
+        if (*ptr == '\0')
+        {
+            *pending = -1;
+            return size;
+        }
+
+        length = strtol(ptr, &key, 10);
+
+        // The length was split by the end of data
+        if (key == end)
+            break;
+
+        if (length <= 0 || *key != ' ')
+            return -2;
+
+        if (length > end - ptr)
+        {
+            *pending = length;
+            break;
+        }
+
+        record_end = ptr + length - 1;
+        key++;
+
+        // The length also counts its own digits and the space
+        if (record_end <= key)
+            return -2;
+
+        value = memchr(key, '=', (size_t)(record_end - key));
+
+        if (*record_end != '\n' || value == NULL)
+            return -2;
+
+        *record_end = '\0';
+        *value++ = '\0';
+
+        if (!strcmp(key, "path"))
+            snprintf(reader->next_name, TAR_MAX_NAME_SIZE, "%s", value);
+        else if (!strcmp(key, "size"))
+            reader->next_size = strtoll(value, NULL, 10);
+
+        ptr = record_end + 1;
+    }
+
+    return ptr - data;
+}
+
+/**
+ * Reads a pax ('x') header in parts of TAR_MAX_PAX_SIZE bytes, records that
+ * don't fit (big xattrs or ACLs) aren't needed and are skipped
+ * @param reader tar reader
+ * @param data memory with the smaller of size and TAR_MAX_PAX_SIZE, + 1 bytes
+ * @param size number of bytes of the header
+ * @return 	0 -> all ok;
+ * 			-1 -> error reading;
+ * 			-2 -> invalid or truncated stream
+ */
+static int readPax(struct tar_reader *reader, char *data, long long size)
+{
+    // bytes in data not parsed yet and bytes of the header not read yet
+    long long have = 0;
+    long long left = size;
+    long long used;
+    long long pending;
+    long long n;
+    int ret;
+
+    while (have > 0 || left > 0)
+    {
+        n = left < TAR_MAX_PAX_SIZE - have ? left : TAR_MAX_PAX_SIZE - have;
+
+        if (n > 0)
+        {
+            long long r = readFull(reader->fd, data + have, n);
+
+            if (r == -1)
+                return -1;
+            if (r < n)
+                return -2;
+
+            have += n;
+            left -= n;
+        }
+
+        data[have] = '\0';
+
+        if ((used = parsePax(reader, data, have, &pending)) < 0)
+            return -2;
+
+        if (pending == -1)
+            return skipBytes(reader->fd, left);
+
+        if (used == have)
+        {
+            have = 0;
+            continue;
+        }
+
+        // The last record is incomplete and there's nothing else to read
+        if (left == 0)
+            return -2;
+
+        if (used == 0 && have == TAR_MAX_PAX_SIZE)
+        {
+            if (pending == 0 || pending - have > left)
+                return -2;
+
+            if ((ret = skipBytes(reader->fd, pending - have)))
+                return ret;
+
+            left -= pending - have;
+            have = 0;
+            continue;
+        }
+
+        memmove(data, data + used, (size_t)(have - used));
+        have -= used;
+    }
+
+    return 0;
+}
+
+/**
+ * Reads the content of a pax ('x') or GNU long name ('L') header
+ * @param reader tar reader
+ * @param type typeflag of the header
+ * @param size number of bytes of the content
+ * @return 	0 -> all ok;
+ * 			-1 -> error reading;
+ * 			-2 -> invalid or truncated stream
+ */
+static int readExtendedHeader(struct tar_reader *reader, char type, long long size)
+{
+    char *data;
+    long long n;
+    long long length = size < TAR_MAX_PAX_SIZE ? size : TAR_MAX_PAX_SIZE;
+    int ret = 0;
+
+    // +1 for the terminator '\0'
+    data = MALLOC((size_t)length + 1);
+    if (data == NULL)
+        return -1;
+
+    if (type == 'x')
+        ret = readPax(reader, data, size);
+    else if ((n = readFull(reader->fd, data, length)) == -1)
+        ret = -1;
+    else if (n < length)
+        ret = -2;
+    else
+    {
+        // Longer names are truncated by next_name anyway
+        data[length] = '\0';
+        snprintf(reader->next_name, TAR_MAX_NAME_SIZE, "%s", data);
+        ret = skipBytes(reader->fd, size - length);
+    }
+
+    FREE(data);
+
+    return ret;
+}
+
+/**
+ * Initializes a tar reader
+ * @param reader tar reader
+ * @param fd file descriptor of the stream, positioned at the first header
+ * @return Nothing returned
+ */
+void tarInit(struct tar_reader *reader, int fd)
+{
+    reader->fd = fd;
+    reader->remaining = 0;
+    reader->padding = 0;
+    reader->next_name[0] = '\0';
+    reader->next_size = -1;
+}
+
+/**
+ * Moves to the next member of the archive, skipping the data of the current one
+ * @param reader tar reader
+ * @param member struct where the member information will be stored
+ * @return 	1 -> member read;
+ * 			0 -> end of archive;
+ * 			-1 -> error reading (errno is set);
+ * 			-2 -> invalid or truncated stream
+ */
+int tarNext(struct tar_reader *reader, struct tar_member *member)
+{
+    unsigned char block[TAR_BLOCK_SIZE];
+    long long size;
+    long long n;
+    int ret;
+    char type;
+
+    // Skipping what's left of the previous member
+    if ((ret = skipBytes(reader->fd, reader->remaining + reader->padding)))
+        return ret;
+
+    reader->remaining = 0;
+    reader->padding = 0;
+
+    while (1)
+    {
+        errno = 0;
+        n = readFull(reader->fd, block, TAR_BLOCK_SIZE);
+
+        if (n == -1)
+            return -1;
+
+        // Some writers don't add the two zero blocks at the end
+        if (n == 0)
+            return 0;
+
+        if (n < TAR_BLOCK_SIZE)
+            return -2;
+
+        // A zero block marks the end of the archive
+        size_t i = 0;
+        while (i < TAR_BLOCK_SIZE && block[i] == 0)
+            i++;
+        if (i == TAR_BLOCK_SIZE)
+            return 0;
+
+        if (verifyChecksum(block) || parseNumber(block + TAR_SIZE, TAR_SIZE_SIZE, &size))
+            return -2;
+
+        type = (char)block[TAR_TYPEFLAG];
+
+        // Extended headers describe the next member, they aren't members
+        if (type == 'x' || type == 'L')
+        {
+            if ((ret = readExtendedHeader(reader, type, size)))
+                return ret;
+            if ((ret = skipBytes(reader->fd, (TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE)))
+                return ret;
+            continue;
+        }
+
+        // Global pax headers and GNU long link names aren't needed
+        if (type == 'g' || type == 'K')
+        {
+            if ((ret = skipBytes(reader->fd, size + (TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE)))
+                return ret;
+            continue;
+        }
+
+        break;
+    }
+
+    if (reader->next_name[0] != '\0')
+        snprintf(member->name, TAR_MAX_NAME_SIZE, "%s", reader->next_name);
+    // GNU headers ("ustar  ") keep other fields where POSIX keeps the prefix
+    else if (!memcmp(block + TAR_MAGIC, "ustar", 6) && block[TAR_PREFIX] != '\0')
+        snprintf(member->name, TAR_MAX_NAME_SIZE, "%.*s/%.*s", TAR_PREFIX_SIZE, block + TAR_PREFIX, TAR_NAME_SIZE, block + TAR_NAME);
+    else
+        snprintf(member->name, TAR_MAX_NAME_SIZE, "%.*s", TAR_NAME_SIZE, block + TAR_NAME);
+
+    if (reader->next_size >= 0)
+        size = reader->next_size;
+
+    reader->next_name[0] = '\0';
+    reader->next_size = -1;
+
+    member->size = size;
+    member->is_file = type == '0' || type == '\0' || type == '7';
+
+    // Links, devices, fifos and directories have no data even if size is set
+    if (type >= '1' && type <= '6')
+        size = 0;
+
+    reader->remaining = size;
+    reader->padding = (TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+
+    return 1;
+}
+
+/**
+ * Reads data of the current member
+ * @param reader tar reader
+ * @param buffer memory where the data will be stored
+ * @param size maximum number of bytes to read
+ * @return 	number of bytes read (0 when there's no more data);
+ * 			-1 -> error reading (errno is set);
+ * 			-2 -> truncated stream
+ */
+long long tarReadData(struct tar_reader *reader, void *buffer, long long size)
+{
+    long long n;
+
+    if (size > reader->remaining)
+        size = reader->remaining;
+
+    n = readFull(reader->fd, buffer, size);
+
+    if (n == -1)
+        return -1;
+
+    if (n < size)
+        return -2;
+
+    reader->remaining -= n;
+
+    return n;
+}
@@ -0,0 +1,39 @@
+/**
+ * @file tar.h
+ * @brief Single pass reader of tar (ustar/pax) streams
+ * @date 2021-10-5
+ * @author Ricardo dos Santos Franco 2202314
+ */
+
+#ifndef TAR_H
+#define TAR_H
+
+#define TAR_BLOCK_SIZE 512
+#define TAR_MAX_NAME_SIZE 4096
+// pax extended headers are parsed in parts of this size, longer records are skipped
+#define TAR_MAX_PAX_SIZE 65536
+
+struct tar_member
+{
+    char name[TAR_MAX_NAME_SIZE];
+    long long size;
+    // 1 for regular files, 0 for directories, links, devices...
+    int is_file;
+};
+
+struct tar_reader
+{
+    int fd;
+    // bytes of the current member not yet read and padding until the next header
+    long long remaining;
+    long long padding;
+    // name and size given by pax ('x') or GNU ('L') headers for the next member
+    char next_name[TAR_MAX_NAME_SIZE];
+    long long next_size;
+};
+
+void tarInit(struct tar_reader *reader, int fd);
+int tarNext(struct tar_reader *reader, struct tar_member *member);
+long long tarReadData(struct tar_reader *reader, void *buffer, long long size);
+
+#endif /* TAR_H */